@@ -0,0 +1,80 @@
+#ifndef BENCHMARK_HPP
+#define BENCHMARK_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include "floodit.hpp"
+
+/**
+ * Boards and timing shared by the benchmarks.
+ */
+namespace bench {
+
+/**
+ * Square board with uniformly random colors.
+ *
+ * The colors are generated from a fixed seed, so every run of a benchmark
+ * gets the same boards.
+ */
+struct Puzzle
+{
+	unsigned size, numColors, seed;
+
+	/// Colors of the cells, row by row.
+	std::vector<color_t> cells() const
+	{
+		std::vector<color_t> result(size * size);
+		std::mt19937 mt(seed);
+		std::uniform_int_distribution<int> dist(0, numColors - 1);
+		for (color_t &color : result)
+			color = dist(mt);
+		return result;
+	}
+
+	/// Reduced graph of the board, with the root in the upper left corner.
+	Graph graph() const { return Graph::fromGrid(size, size, cells(), 0); }
+};
+
+/// Milliseconds that have passed since @p start.
+inline double millisecondsSince(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(
+		std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * Run something a few times and return the best time.
+ * @param f Function that returns the time it took, in milliseconds. Setup
+ *        that shouldn't be measured can happen before it starts the clock.
+ * @param runs Number of runs.
+ * @return Best time in milliseconds.
+ */
+template<typename F>
+double bestTime(F f, unsigned runs = 3)
+{
+	double best = 0;
+	for (unsigned run = 0; run != runs; ++run) {
+		double time = f();
+		best = run == 0 ? time : std::min(best, time);
+	}
+	return best;
+}
+
+/**
+ * Time a function.
+ * @return Time in milliseconds that @p f took.
+ */
+template<typename F>
+double measure(F f)
+{
+	auto start = std::chrono::steady_clock::now();
+	f();
+	return millisecondsSince(start);
+}
+
+} // namespace bench
+
+#endif
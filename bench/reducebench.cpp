@@ -0,0 +1,115 @@
+/**
+ * Benchmark for Graph::reduce on large generated boards.
+ *
+ * Every board is built with a node per cell and reduced, and also built
+ * directly with Graph::fromGrid. We report the best time out of a few runs.
+ */
+#include <cstdio>
+#include <functional>
+#include <vector>
+
+#include "benchmark.hpp"
+
+namespace {
+
+/// Board of colors in row-major order.
+struct Board
+{
+	const char *name;
+	unsigned rows, columns;
+	std::vector<color_t> colors;
+};
+
+Graph createGraph(const Board &board)
+{
+	Graph graph(board.rows * board.columns);
+	for (unsigned i = 0; i < board.rows; ++i) {
+		for (unsigned j = 0; j < board.columns; ++j) {
+			unsigned index = i * board.columns + j;
+			if (i > 0)
+				graph.addEdge(index - board.columns, index);
+			if (j > 0)
+				graph.addEdge(index - 1, index);
+
+			graph.setColor(index, board.colors[index]);
+		}
+	}
+	return graph;
+}
+
+/// Uniformly random colors, giving lots of small regions.
+Board randomBoard(const char *name, unsigned size, unsigned numColors)
+{
+	bench::Puzzle puzzle{size, numColors, size * numColors};
+	return Board{name, size, size, puzzle.cells()};
+}
+
+/**
+ * A single snake of color 0 winding through the board, with walls of color 1
+ * in between. This gives one huge region with a very long path through it.
+ */
+Board snakeBoard(const char *name, unsigned size)
+{
+	Board board{name, size, size, std::vector<color_t>(size * size, 1)};
+	for (unsigned i = 0; i < size; ++i) {
+		for (unsigned j = 0; j < size; ++j) {
+			// Even rows belong to the snake, odd rows only at alternating ends.
+			bool end = (i % 4 == 1) ? j == size - 1 : j == 0;
+			if (i % 2 == 0 || end)
+				board.colors[i * size + j] = 0;
+		}
+	}
+	return board;
+}
+
+/// Number of runs of every variant.
+constexpr unsigned RUNS = 5;
+
+void run(const Board &board)
+{
+	unsigned numNodes = 0;
+
+	// Only the reduction.
+	double reduce = bench::bestTime([&]() {
+		Graph graph = createGraph(board);
+		double time = bench::measure([&]() { graph.reduce(); });
+		numNodes = graph.getNumNodes();
+		return time;
+	}, RUNS);
+
+	// Building the graph with a node per cell and reducing it.
+	double build = bench::bestTime([&]() {
+		return bench::measure([&]() {
+			Graph graph = createGraph(board);
+			graph.reduce();
+		});
+	}, RUNS);
+
+	// Building the reduced graph directly.
+	double direct = bench::bestTime([&]() {
+		return bench::measure([&]() {
+			Graph graph =
+				Graph::fromGrid(board.rows, board.columns, board.colors, 0);
+		});
+	}, RUNS);
+
+	std::printf("%-10s %5ux%-5u %7u nodes  reduce %7.1f ms  "
+	            "build+reduce %7.1f ms  fromGrid %7.1f ms\n", board.name,
+	            board.rows, board.columns, numNodes, reduce, build, direct);
+}
+
+} // anonymous namespace
+
+int main()
+{
+	const std::function<Board()> boards[] = {
+		[]() { return randomBoard("random-6", 1000, 6); },
+		[]() { return randomBoard("random-3", 1000, 3); },
+		[]() { return randomBoard("random-2", 2000, 2); },
+		[]() { return snakeBoard("snake", 1000); },
+		[]() { return snakeBoard("snake", 2000); },
+	};
+
+	for (const std::function<Board()> &board : boards)
+		run(board());
+}
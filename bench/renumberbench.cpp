@@ -0,0 +1,54 @@
+/**
+ * Benchmark for solving with and without renumbering the nodes breadth-first.
+ *
+ * Random boards are generated with fixed seeds, so every run solves the same
+ * puzzles. We report the best time out of a few runs for both variants.
+ */
+#include <cstdio>
+
+#include "benchmark.hpp"
+
+namespace {
+
+double solve(const Graph &graph, unsigned &numMoves)
+{
+	return bench::bestTime([&]() {
+		return bench::measure([&]() {
+			numMoves = computeBestSequence(graph).size() - 1;
+		});
+	});
+}
+
+} // anonymous namespace
+
+int main()
+{
+	const bench::Puzzle puzzles[] = {
+		{14, 6, 1}, {14, 6, 2}, {16, 6, 3}, {16, 5, 4}, {18, 4, 5},
+		{24, 3, 6}, {32, 3, 7}, {40, 3, 8},
+	};
+
+	double totalBefore = 0, totalAfter = 0;
+	for (const bench::Puzzle &puzzle : puzzles) {
+		Graph graph = puzzle.graph();
+		unsigned movesBefore, movesAfter;
+		double before = solve(graph, movesBefore);
+		graph.renumberBreadthFirst();
+		double after = solve(graph, movesAfter);
+		if (movesBefore != movesAfter) {
+			std::fprintf(stderr, "Different number of moves: %u vs. %u\n",
+			             movesBefore, movesAfter);
+			return 1;
+		}
+
+		std::printf("%3ux%-3u %u colors %4u nodes %3u moves  "
+		            "scan order %8.1f ms  breadth-first %8.1f ms\n",
+		            puzzle.size, puzzle.size, puzzle.numColors,
+		            graph.getNumNodes(), movesAfter, before, after);
+		totalBefore += before;
+		totalAfter += after;
+	}
+
+	std::printf("total: scan order %.1f ms, breadth-first %.1f ms\n",
+	            totalBefore, totalAfter);
+}
@@ -0,0 +1,172 @@
+/**
+ * Benchmark for appending to a trie from multiple threads.
+ *
+ * The scenarios of the trie tests are run by every thread at once: building
+ * long sequences, branching off a common sequence, and continuing sequences
+ * that another thread has built. We compare ConcurrentTrie with a single trie
+ * guarded by a mutex, and report the best time out of a few runs.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "benchmark.hpp"
+#include "concurrenttrie.hpp"
+
+namespace {
+
+using Sequence = Trie<unsigned char>::Sequence;
+
+/// Single trie for all threads, guarded by a mutex.
+class LockedTrie
+{
+public:
+	Sequence append(Sequence sequence, unsigned char element)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return trie.append(sequence, element);
+	}
+
+private:
+	std::mutex mutex;
+	Trie<unsigned char> trie;
+};
+
+constexpr unsigned LENGTH = 64;
+constexpr unsigned SEQUENCES = 1 << 14;
+
+/// Sum of the last elements, so that nothing is optimized away.
+volatile unsigned checksum;
+
+/// Every thread builds sequences from scratch.
+template<typename SharedTrie>
+unsigned chains(SharedTrie &trie, const std::vector<Sequence> &,
+                std::vector<Sequence> &, unsigned index, unsigned numThreads)
+{
+	unsigned sum = 0;
+	for (unsigned i = index; i < SEQUENCES; i += numThreads) {
+		Sequence sequence = Trie<unsigned char>::initial();
+		for (unsigned j = 0; j < LENGTH; ++j)
+			sequence = trie.append(sequence, i + j);
+		sum += sequence.back();
+	}
+	return sum;
+}
+
+/// Every thread branches off the same sequences.
+template<typename SharedTrie>
+unsigned branches(SharedTrie &trie, const std::vector<Sequence> &input,
+                  std::vector<Sequence> &, unsigned index, unsigned numThreads)
+{
+	unsigned sum = 0;
+	for (unsigned i = index; i < SEQUENCES; i += numThreads) {
+		Sequence sequence = input[i % LENGTH];
+		for (unsigned j = 0; j < LENGTH; ++j)
+			sequence = trie.append(sequence, i + j);
+		sum += sequence.back();
+	}
+	return sum;
+}
+
+/// Every thread continues the sequences that another thread has built.
+template<typename SharedTrie>
+unsigned handoff(SharedTrie &trie, const std::vector<Sequence> &input,
+                 std::vector<Sequence> &output, unsigned index,
+                 unsigned numThreads)
+{
+	unsigned sum = 0;
+	for (unsigned i = index; i < SEQUENCES; i += numThreads) {
+		Sequence sequence = input[(i + 1) % SEQUENCES];
+		for (unsigned j = 0; j < LENGTH / 8; ++j)
+			sequence = trie.append(sequence, i + j);
+		output[i] = sequence;
+		sum += sequence.back();
+	}
+	return sum;
+}
+
+using Scenario = unsigned (*)(LockedTrie&, const std::vector<Sequence>&,
+                              std::vector<Sequence>&, unsigned, unsigned);
+using ConcurrentScenario = unsigned (*)(
+	ConcurrentTrie<unsigned char>&, const std::vector<Sequence>&,
+	std::vector<Sequence>&, unsigned, unsigned);
+
+/**
+ * Run a scenario with a number of threads.
+ * @param rounds Number of times to run it, with the output of one round as
+ *        input for the next.
+ * @return Time in milliseconds.
+ */
+template<typename SharedTrie, typename Function>
+double run(Function scenario, unsigned numThreads, unsigned rounds)
+{
+	SharedTrie trie;
+
+	// Start with sequences of increasing length.
+	std::vector<Sequence> input(SEQUENCES, Trie<unsigned char>::initial());
+	for (unsigned i = 1; i < SEQUENCES; ++i)
+		input[i] = i < LENGTH ? trie.append(input[i-1], i) : input[i % LENGTH];
+	std::vector<Sequence> output = input;
+
+	std::vector<unsigned> sums(numThreads);
+	auto start = std::chrono::steady_clock::now();
+	for (unsigned round = 0; round != rounds; ++round) {
+		std::vector<std::thread> threads;
+		for (unsigned index = 0; index != numThreads; ++index)
+			threads.emplace_back([&, index]() {
+				sums[index] += scenario(trie, input, output, index, numThreads);
+			});
+		for (std::thread &thread : threads)
+			thread.join();
+		input.swap(output);
+	}
+	double time = bench::millisecondsSince(start);
+
+	for (unsigned sum : sums)
+		checksum = checksum + sum;
+	return time;
+}
+
+template<typename SharedTrie, typename Function>
+double best(Function scenario, unsigned numThreads, unsigned rounds)
+{
+	return bench::bestTime([&]() {
+		return run<SharedTrie>(scenario, numThreads, rounds);
+	});
+}
+
+} // anonymous namespace
+
+int main()
+{
+	struct {
+		const char *name;
+		Scenario locked;
+		ConcurrentScenario concurrent;
+		unsigned rounds;
+	} const scenarios[] = {
+		{"chains", chains<LockedTrie>, chains<ConcurrentTrie<unsigned char>>,
+		 4},
+		{"branches", branches<LockedTrie>,
+		 branches<ConcurrentTrie<unsigned char>>, 4},
+		{"handoff", handoff<LockedTrie>,
+		 handoff<ConcurrentTrie<unsigned char>>, 32},
+	};
+
+	unsigned maxThreads = std::max(4u, std::thread::hardware_concurrency());
+	for (const auto &scenario : scenarios) {
+		for (unsigned numThreads = 1; numThreads <= maxThreads;
+		     numThreads *= 2) {
+			double locked =
+				best<LockedTrie>(scenario.locked, numThreads, scenario.rounds);
+			double concurrent = best<ConcurrentTrie<unsigned char>>(
+				scenario.concurrent, numThreads, scenario.rounds);
+			std::printf("%-8s %3u threads  mutex %8.1f ms  "
+			            "per-thread %8.1f ms\n", scenario.name, numThreads,
+			            locked, concurrent);
+		}
+	}
+}
@@ -0,0 +1,112 @@
+/**
+ * Benchmark for generating children, which is mostly computing valuations.
+ *
+ * For random boards with fixed seeds, we collect the states of the first few
+ * levels of the search tree, and generate all children of them. The searches
+ * generate the children of a state one after another, so that they can share
+ * the layers of their parent. We compare that with generating them by color,
+ * where every child has another parent than the one before, as a worst case.
+ * We report the best time out of a few runs for both orders.
+ */
+#include <cstdio>
+#include <vector>
+
+#include "benchmark.hpp"
+
+namespace {
+
+constexpr unsigned MAX_STATES = 1 << 14;
+
+/// Collect states breadth-first from the initial state.
+std::vector<State> collectStates(const Graph &graph, State::MoveTrie &trie)
+{
+	std::vector<State> states{State(graph, trie)};
+	color_t numColors = graph.getColorCounts().size();
+	for (std::size_t index = 0; index < states.size(); ++index) {
+		for (color_t next = 0; next < numColors; ++next) {
+			if (states.size() == MAX_STATES)
+				return states;
+			if (next == states[index].getLastColor())
+				continue;
+
+			State child = states[index];
+			if (child.move(graph, trie, next))
+				states.push_back(std::move(child));
+		}
+	}
+	return states;
+}
+
+/// Sum of the valuations, so that nothing is optimized away.
+volatile unsigned checksum;
+
+/**
+ * Generate the children of all states.
+ * @param byState Generate the children of a state one after another,
+ *        otherwise those of all states for one color after another.
+ * @return Sum of the valuations of the children.
+ */
+unsigned generate(const Graph &graph, const std::vector<State> &states,
+                  bool byState)
+{
+	State::MoveTrie trie;
+	State child = states.front();
+	color_t numColors = graph.getColorCounts().size();
+	std::size_t numStates = states.size();
+	unsigned sum = 0;
+	for (std::size_t index = 0; index != numStates * numColors; ++index) {
+		const State &state = byState
+			? states[index / numColors] : states[index % numStates];
+		color_t next = byState ? index % numColors : index / numStates;
+		if (next == state.getLastColor())
+			continue;
+
+		child = state;
+		if (child.move(graph, trie, next))
+			sum += child.getValuation();
+	}
+	return sum;
+}
+
+double measure(const Graph &graph, const std::vector<State> &states,
+               bool byState)
+{
+	return bench::bestTime([&]() {
+		return bench::measure([&]() {
+			checksum = generate(graph, states, byState);
+		});
+	});
+}
+
+} // anonymous namespace
+
+int main()
+{
+	const bench::Puzzle puzzles[] = {
+		{14, 6, 1}, {18, 6, 2}, {24, 6, 3}, {24, 4, 4}, {32, 8, 5},
+		{40, 3, 6}, {64, 6, 7},
+	};
+
+	double totalByState = 0, totalByColor = 0;
+	for (const bench::Puzzle &puzzle : puzzles) {
+		Graph graph = puzzle.graph();
+		State::MoveTrie trie;
+		std::vector<State> states = collectStates(graph, trie);
+		if (generate(graph, states, true) != generate(graph, states, false)) {
+			std::fprintf(stderr, "Valuations differ\n");
+			return 1;
+		}
+
+		double byState = measure(graph, states, true);
+		double byColor = measure(graph, states, false);
+		std::printf("%3ux%-3u %u colors %4u nodes %5zu states  "
+		            "by state %7.1f ms  by color %7.1f ms\n",
+		            puzzle.size, puzzle.size, puzzle.numColors,
+		            graph.getNumNodes(), states.size(), byState, byColor);
+		totalByState += byState;
+		totalByColor += byColor;
+	}
+
+	std::printf("total: by state %.1f ms, by color %.1f ms\n",
+	            totalByState, totalByColor);
+}
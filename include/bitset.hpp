@@ -0,0 +1,238 @@
+#ifndef BITSET_HPP
+#define BITSET_HPP
+
+#include <cstdint>
+
+// On x86 we can compile AVX2 and POPCNT kernels for functions of their own,
+// even if the compiler doesn't target these otherwise, and choose them at run
+// time.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BITS_X86
+#include <immintrin.h>
+#endif
+
+/**
+ * Word-level operations on fixed-width bit sets.
+ *
+ * A set of @c n bits is stored in numWords(n) consecutive words, bit @c i
+ * being bit <tt>i % WORD_BITS</tt> of word <tt>i / WORD_BITS</tt>. Bits beyond
+ * the width are always zero. The storage belongs to the caller, so sets of the
+ * same width can be packed together without any allocations of their own.
+ *
+ * The whole-word kernels use AVX2 where the machine has it. Unless the
+ * compiler targets AVX2 anyway, they are then calls to separate functions, so
+ * we only use them for sets of at least four words. Counting uses the POPCNT
+ * instruction where the machine has it, since otherwise every word is counted
+ * by a library call.
+ */
+namespace bits {
+
+typedef std::uint64_t word_t;
+
+constexpr unsigned WORD_BITS = 64;
+
+#ifdef BITS_X86
+namespace detail {
+
+/// Should kernels use AVX2 for sets of @p numWords words?
+inline bool useAvx2(unsigned numWords)
+{
+#ifdef __AVX2__
+	return numWords >= 4;
+#else
+	static const bool supported = (__builtin_cpu_init(),
+	                               __builtin_cpu_supports("avx2"));
+	return numWords >= 4 && supported;
+#endif
+}
+
+/// Can kernels use the POPCNT instruction?
+inline bool usePopcnt()
+{
+#ifdef __POPCNT__
+	return true;
+#else
+	static const bool supported = (__builtin_cpu_init(),
+	                               __builtin_cpu_supports("popcnt"));
+	return supported;
+#endif
+}
+
+__attribute__((target("avx2")))
+inline __m256i load(const word_t *words)
+{
+	return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(words));
+}
+
+__attribute__((target("avx2")))
+inline void store(word_t *words, __m256i vector)
+{
+	_mm256_storeu_si256(reinterpret_cast<__m256i*>(words), vector);
+}
+
+// The AVX2 parts of the kernels below. They handle whole vectors of four
+// words, and return the number of words done. The POPCNT kernel does all words.
+
+__attribute__((target("avx2")))
+inline unsigned intersect(word_t *result, const word_t *a, const word_t *b,
+                          unsigned numWords, word_t &any)
+{
+	unsigned word = 0;
+	__m256i anyVector = _mm256_setzero_si256();
+	for (; word + 4 <= numWords; word += 4) {
+		__m256i x = _mm256_and_si256(load(a + word), load(b + word));
+		store(result + word, x);
+		anyVector = _mm256_or_si256(anyVector, x);
+	}
+	any = !_mm256_testz_si256(anyVector, anyVector);
+	return word;
+}
+
+__attribute__((target("avx2")))
+inline unsigned transfer(word_t *to, word_t *from, const word_t *set,
+                         unsigned numWords)
+{
+	unsigned word = 0;
+	for (; word + 4 <= numWords; word += 4) {
+		__m256i s = load(set + word);
+		store(to + word, _mm256_or_si256(load(to + word), s));
+		store(from + word, _mm256_andnot_si256(s, load(from + word)));
+	}
+	return word;
+}
+
+__attribute__((target("avx2")))
+inline unsigned countFull(const word_t *set, unsigned numWords)
+{
+	const __m256i ones = _mm256_set1_epi64x(-1);
+	unsigned word = 0;
+	for (; word + 4 <= numWords; word += 4)
+		if (!_mm256_testc_si256(load(set + word), ones))
+			break;
+	return word;
+}
+
+__attribute__((target("popcnt")))
+inline unsigned countIntersection(const word_t *a, const word_t *b,
+                                  unsigned numWords)
+{
+	unsigned count = 0;
+	for (unsigned word = 0; word < numWords; ++word)
+		count += __builtin_popcountll(a[word] & b[word]);
+	return count;
+}
+
+} // namespace detail
+#endif
+
+/// Number of words needed to store @p numBits bits.
+inline unsigned numWords(unsigned numBits)
+{
+	return (numBits + WORD_BITS - 1) / WORD_BITS;
+}
+
+/// Is bit @p index in @p set?
+inline bool test(const word_t *set, unsigned index)
+{
+	return (set[index / WORD_BITS] >> (index % WORD_BITS)) & 1;
+}
+
+/// Add bit @p index to @p set.
+inline void set(word_t *set, unsigned index)
+{
+	set[index / WORD_BITS] |= word_t(1) << (index % WORD_BITS);
+}
+
+/// Remove bit @p index from @p set.
+inline void reset(word_t *set, unsigned index)
+{
+	set[index / WORD_BITS] &= ~(word_t(1) << (index % WORD_BITS));
+}
+
+/**
+ * Call @p f for every bit in @p set, in ascending order.
+ */
+template<typename F>
+void forEach(const word_t *set, unsigned numWords, F f)
+{
+	for (unsigned word = 0; word < numWords; ++word)
+		for (word_t w = set[word]; w != 0; w &= w - 1)
+			f(word * WORD_BITS + __builtin_ctzll(w));
+}
+
+/**
+ * Store the intersection of @p a and @p b in @p result.
+ * @return True, if the intersection is not empty.
+ */
+inline bool intersect(word_t *result, const word_t *a, const word_t *b,
+                      unsigned numWords)
+{
+	word_t any = 0;
+	unsigned word = 0;
+#ifdef BITS_X86
+	if (detail::useAvx2(numWords))
+		word = detail::intersect(result, a, b, numWords, any);
+#endif
+	for (; word < numWords; ++word)
+		any |= result[word] = a[word] & b[word];
+	return any != 0;
+}
+
+/**
+ * Move the bits of @p set from @p from to @p to.
+ *
+ * That is, @p to becomes the union of @p to and @p set, and @p from loses all
+ * bits in @p set. The caller should make sure that @p set is a subset of
+ * @p from.
+ */
+inline void transfer(word_t *to, word_t *from, const word_t *set,
+                     unsigned numWords)
+{
+	unsigned word = 0;
+#ifdef BITS_X86
+	if (detail::useAvx2(numWords))
+		word = detail::transfer(to, from, set, numWords);
+#endif
+	for (; word < numWords; ++word) {
+		to[word] |= set[word];
+		from[word] &= ~set[word];
+	}
+}
+
+/**
+ * Count the bits in the intersection of @p a and @p b.
+ */
+inline unsigned countIntersection(const word_t *a, const word_t *b,
+                                  unsigned numWords)
+{
+#ifdef BITS_X86
+	if (detail::usePopcnt())
+		return detail::countIntersection(a, b, numWords);
+#endif
+	unsigned count = 0;
+	for (unsigned word = 0; word < numWords; ++word)
+		count += __builtin_popcountll(a[word] & b[word]);
+	return count;
+}
+
+/**
+ * Does @p set contain all of the first @p numBits bits?
+ */
+inline bool isFull(const word_t *set, unsigned numBits)
+{
+	unsigned numFull = numBits / WORD_BITS, word = 0;
+#ifdef BITS_X86
+	if (detail::useAvx2(numFull))
+		word = detail::countFull(set, numFull);
+#endif
+	for (; word < numFull; ++word)
+		if (~set[word] != 0)
+			return false;
+
+	unsigned rest = numBits % WORD_BITS;
+	return rest == 0 || set[numFull] == (word_t(1) << rest) - 1;
+}
+
+} // namespace bits
+
+#endif
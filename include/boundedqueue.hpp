@@ -0,0 +1,275 @@
+#ifndef BOUNDEDQUEUE_HPP
+#define BOUNDEDQUEUE_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+/**
+ * First-in first-out queue of limited capacity for multiple producers and
+ * consumers.
+ *
+ * Elements are stored in a ring buffer, where every slot has a sequence number
+ * telling whether it is ready to be written or read in the current round
+ * (Vyukov's bounded queue). Producers and consumers claim slots by moving their
+ * position forward, so pushing and popping needs no lock.
+ *
+ * Only a thread that has to wait, because the queue is full or empty, takes
+ * a lock and sleeps until the other side wakes it. The time spent waiting is
+ * counted, which shows where a pipeline is stuck.
+ */
+template<typename T>
+class BoundedQueue
+{
+public:
+	/// Time spent waiting on one side of the queue.
+	struct WaitStats
+	{
+		std::uint64_t waits;            // How often a thread had to wait.
+		double seconds;                 // How long, over all threads.
+	};
+
+	/**
+	 * Create an empty queue.
+	 * @param capacity Number of elements, rounded up to a power of two.
+	 */
+	explicit BoundedQueue(std::size_t capacity)
+		: mask(roundUp(capacity) - 1), slots(new Slot[mask + 1]),
+		  pushPosition(0), popPosition(0), closed(false),
+		  numPushWaiting(0), numPopWaiting(0)
+	{
+		for (std::size_t index = 0; index <= mask; ++index)
+			slots[index].sequence.store(index, std::memory_order_relaxed);
+	}
+
+	BoundedQueue(const BoundedQueue&) = delete;
+	BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+	std::size_t capacity() const { return mask + 1; }
+
+	/**
+	 * Add an element if there is room.
+	 * @return False, if the queue is full.
+	 */
+	bool tryPush(T &element)
+	{
+		if (!insert(element))
+			return false;
+		wake(numPopWaiting, popReady);
+		return true;
+	}
+
+	/**
+	 * Remove the oldest element if there is one.
+	 * @return False, if the queue is empty.
+	 */
+	bool tryPop(T &element)
+	{
+		if (!remove(element))
+			return false;
+		wake(numPushWaiting, pushReady);
+		return true;
+	}
+
+	/// Add an element, waiting for room if the queue is full.
+	void push(T &&element)
+	{
+		if (tryPush(element))
+			return;
+
+		Timer timer(pushStats);
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			numPushWaiting.fetch_add(1);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			while (!insert(element))
+				pushReady.wait(lock);
+			numPushWaiting.fetch_sub(1);
+		}
+		wake(numPopWaiting, popReady);
+	}
+
+	/**
+	 * Remove the oldest element, waiting for one if the queue is empty.
+	 * @return False, if the queue is empty and has been closed.
+	 */
+	bool pop(T &element)
+	{
+		if (tryPop(element))
+			return true;
+
+		Timer timer(popStats);
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			numPopWaiting.fetch_add(1);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			while (!remove(element)) {
+				// Elements pushed before closing must still be taken.
+				if (closed.load() && !remove(element)) {
+					numPopWaiting.fetch_sub(1);
+					return false;
+				}
+				popReady.wait(lock);
+			}
+			numPopWaiting.fetch_sub(1);
+		}
+		wake(numPushWaiting, pushReady);
+		return true;
+	}
+
+	/// Signal that nothing will be pushed anymore, and wake waiting consumers.
+	void close()
+	{
+		closed.store(true);
+		std::lock_guard<std::mutex> lock(mutex);
+		popReady.notify_all();
+	}
+
+	/// Waiting of producers because the queue was full.
+	WaitStats getPushStats() const { return pushStats.get(); }
+
+	/// Waiting of consumers because the queue was empty.
+	WaitStats getPopStats() const { return popStats.get(); }
+
+private:
+	struct Slot
+	{
+		std::atomic<std::size_t> sequence;
+		T value;
+	};
+
+	/// Claim a slot for writing and fill it, unless the queue is full.
+	bool insert(T &element)
+	{
+		std::size_t position = pushPosition.load(std::memory_order_relaxed);
+		Slot *slot;
+		while (true) {
+			slot = &slots[position & mask];
+			std::size_t sequence =
+				slot->sequence.load(std::memory_order_acquire);
+			std::ptrdiff_t diff = sequence - position;
+			if (diff == 0) {
+				if (pushPosition.compare_exchange_weak(position, position + 1,
+					std::memory_order_relaxed))
+					break;
+			}
+			else if (diff < 0)
+				return false;
+			else
+				position = pushPosition.load(std::memory_order_relaxed);
+		}
+
+		slot->value = std::move(element);
+		slot->sequence.store(position + 1, std::memory_order_release);
+		return true;
+	}
+
+	/// Claim a slot for reading and empty it, unless the queue is empty.
+	bool remove(T &element)
+	{
+		std::size_t position = popPosition.load(std::memory_order_relaxed);
+		Slot *slot;
+		while (true) {
+			slot = &slots[position & mask];
+			std::size_t sequence =
+				slot->sequence.load(std::memory_order_acquire);
+			std::ptrdiff_t diff = sequence - (position + 1);
+			if (diff == 0) {
+				if (popPosition.compare_exchange_weak(position, position + 1,
+					std::memory_order_relaxed))
+					break;
+			}
+			else if (diff < 0)
+				return false;
+			else
+				position = popPosition.load(std::memory_order_relaxed);
+		}
+
+		element = std::move(slot->value);
+		slot->sequence.store(position + mask + 1, std::memory_order_release);
+		return true;
+	}
+
+	/// Accumulated waiting on one side.
+	struct WaitCounter
+	{
+		WaitCounter() : waits(0), nanoseconds(0) {}
+
+		WaitStats get() const
+		{
+			return {waits.load(std::memory_order_relaxed),
+			        nanoseconds.load(std::memory_order_relaxed) * 1e-9};
+		}
+
+		std::atomic<std::uint64_t> waits, nanoseconds;
+	};
+
+	/// Adds the time from construction to destruction to a counter.
+	class Timer
+	{
+	public:
+		explicit Timer(WaitCounter &counter)
+			: counter(counter), start(std::chrono::steady_clock::now()) {}
+
+		~Timer()
+		{
+			auto duration = std::chrono::steady_clock::now() - start;
+			counter.waits.fetch_add(1, std::memory_order_relaxed);
+			counter.nanoseconds.fetch_add(
+				std::chrono::duration_cast<std::chrono::nanoseconds>(
+					duration).count(),
+				std::memory_order_relaxed);
+		}
+
+	private:
+		WaitCounter &counter;
+		const std::chrono::steady_clock::time_point start;
+	};
+
+	/**
+	 * Wake threads waiting on the other side, if there are any.
+	 *
+	 * Waiting threads register before trying again under the lock. Either
+	 * they see our change then, or we see them here: both sides have a fence
+	 * between their change and looking at the other. We notify under the
+	 * lock, so they can't miss it while going to sleep.
+	 */
+	void wake(std::atomic<unsigned> &numWaiting, std::condition_variable &ready)
+	{
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (numWaiting.load(std::memory_order_relaxed) != 0) {
+			std::lock_guard<std::mutex> lock(mutex);
+			ready.notify_all();
+		}
+	}
+
+	static std::size_t roundUp(std::size_t capacity)
+	{
+		std::size_t result = 1;
+		while (result < capacity)
+			result <<= 1;
+		return result;
+	}
+
+private:
+	const std::size_t mask;
+	const std::unique_ptr<Slot[]> slots;
+
+	// Positions of producers and consumers, on separate cache lines.
+	alignas(64) std::atomic<std::size_t> pushPosition;
+	alignas(64) std::atomic<std::size_t> popPosition;
+	alignas(64) std::atomic<bool> closed;
+
+	// Only for waiting.
+	std::atomic<unsigned> numPushWaiting, numPopWaiting;
+	std::mutex mutex;
+	std::condition_variable pushReady, popReady;
+	WaitCounter pushStats, popStats;
+};
+
+#endif
@@ -0,0 +1,135 @@
+#ifndef CONCURRENTTRIE_HPP
+#define CONCURRENTTRIE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include "trie.hpp"
+
+/**
+ * Data structure for move histories that is shared by multiple threads.
+ *
+ * Every thread appends to its own @ref Trie, so appending needs no
+ * synchronization. Sequences are the same trivially copyable values as for a
+ * single trie, and can be handed to other threads, which may append to them in
+ * turn. Stored blocks never move or change, so it's enough to publish them
+ * together with the sequence, for example with a release store.
+ */
+template<typename T, unsigned Bits = 8 * sizeof(T)>
+class ConcurrentTrie
+{
+public:
+	using Sequence = typename Trie<T, Bits>::Sequence;
+	using Stats = typename Trie<T, Bits>::Stats;
+
+	ConcurrentTrie() : arenas(nullptr), id(nextId()) {}
+
+	~ConcurrentTrie()
+	{
+		for (Arena *arena = arenas.load(std::memory_order_acquire), *next;
+		     arena; arena = next) {
+			next = arena->next;
+			delete arena;
+		}
+	}
+
+	ConcurrentTrie(const ConcurrentTrie&) = delete;
+	ConcurrentTrie& operator=(const ConcurrentTrie&) = delete;
+
+	static Sequence initial() { return Trie<T, Bits>::initial(); }
+
+	Sequence append(Sequence sequence, const T &element)
+	{
+		return local().append(sequence, element);
+	}
+
+	/**
+	 * Get the trie of the calling thread.
+	 *
+	 * It can be used for appending like any trie, but only by this thread.
+	 * Storage can't be released with Trie::rewind or Trie::sweep, since other
+	 * threads might still use it.
+	 */
+	Trie<T, Bits>& local()
+	{
+		// Threads usually work with one trie at a time, so we remember the
+		// last one. Tries are told apart by id, since addresses can be reused.
+		thread_local Cache cache;
+		if (cache.id != id) {
+			cache.id = id;
+			cache.trie = &find();
+		}
+		return *cache.trie;
+	}
+
+	/// Statistics over all threads, only exact if no thread is appending.
+	Stats getStats() const
+	{
+		Stats stats{0, 0};
+		for (Arena *arena = arenas.load(std::memory_order_acquire); arena;
+		     arena = arena->next) {
+			Stats local = arena->trie.getStats();
+			stats.liveBlocks += local.liveBlocks;
+			stats.totalBlocks += local.totalBlocks;
+		}
+		return stats;
+	}
+
+	/// Bytes used by the blocks of all threads.
+	std::size_t memoryUsage() const
+	{
+		std::size_t usage = 0;
+		for (Arena *arena = arenas.load(std::memory_order_acquire); arena;
+		     arena = arena->next)
+			usage += arena->trie.memoryUsage();
+		return usage;
+	}
+
+private:
+	/// Trie of one thread.
+	struct Arena
+	{
+		Arena(std::thread::id owner, Arena *next) : owner(owner), next(next) {}
+
+		Trie<T, Bits> trie;
+		const std::thread::id owner;
+		Arena *next;
+	};
+
+	/// Last trie used by a thread.
+	struct Cache
+	{
+		std::uint64_t id = 0;
+		Trie<T, Bits> *trie = nullptr;
+	};
+
+	/// Find the arena of the calling thread, or add one.
+	Trie<T, Bits>& find()
+	{
+		std::thread::id self = std::this_thread::get_id();
+		Arena *head = arenas.load(std::memory_order_acquire);
+		for (Arena *arena = head; arena; arena = arena->next)
+			if (arena->owner == self)
+				return arena->trie;
+
+		// Only we add an arena for this thread, so we don't need to search
+		// again if others have added theirs in the meantime.
+		Arena *arena = new Arena(self, head);
+		while (!arenas.compare_exchange_weak(arena->next, arena,
+			std::memory_order_release, std::memory_order_acquire));
+		return arena->trie;
+	}
+
+	static std::uint64_t nextId()
+	{
+		static std::atomic<std::uint64_t> counter(0);
+		return counter.fetch_add(1, std::memory_order_relaxed) + 1;
+	}
+
+private:
+	std::atomic<Arena*> arenas;     // Lock-free stack, one arena per thread.
+	const std::uint64_t id;         // Unique, unlike the address.
+};
+
+#endif
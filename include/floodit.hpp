@@ -1,22 +1,53 @@
 #ifndef FLOODIT_HPP
 #define FLOODIT_HPP
 
+#include "bitset.hpp"
+#include "helperpool.hpp"
+#include "memorybudget.hpp"
 #include "trie.hpp"
 
+#include <cassert>
+#include <cstdint>
+#include <string>
+#include <utility>
 #include <vector>
 
 typedef unsigned char color_t;
 
+/**
+ * Bits per move in move histories. With 8 bits every color fits, with 4 bits
+ * the trie needs half as many blocks, but only puzzles with up to 16 colors
+ * can be solved.
+ */
+#ifndef MOVE_BITS
+#define MOVE_BITS 8
+#endif
+
 /**
  * Colored undirected graph.
+ *
+ * The graph is built node by node and edge by edge. Once it is reduced, it is
+ * frozen into a compressed sparse row layout: the neighbors of all nodes are
+ * stored contiguously in a single array, delimited by an array of offsets.
  */
 class Graph
 {
 public:
-	struct Node
+	/**
+	 * Contiguous range of node indices.
+	 */
+	class NodeRange
 	{
-		std::vector<unsigned> neighbors;    ///< Sorted list of neighbor nodes.
-		color_t color;                      ///< Color of the node.
+	public:
+		NodeRange(const unsigned *first, const unsigned *last)
+			: first(first), last(last) {}
+
+		const unsigned* begin() const { return first; }
+		const unsigned* end() const { return last; }
+		unsigned size() const { return last - first; }
+
+	private:
+		const unsigned *first, *last;
 	};
 
 public:
@@ -34,11 +65,15 @@ public:
 
 	/**
 	 * Set color of node @p index to @p color.
+	 *
+	 * @pre The graph has not been reduced yet.
 	 */
 	void setColor(unsigned index, color_t color);
 
 	/**
 	 * Add an edge between nodes @p a and @p b.
+	 *
+	 * @pre The graph has not been reduced yet.
 	 */
 	void addEdge(unsigned a, unsigned b);
 
@@ -46,24 +81,104 @@ public:
 	 * Reduce the graph.
 	 *
 	 * We can safely merge adjacent nodes of the same color, because they will
-	 * always be filled together.
+	 * always be filled together. Afterwards the graph is frozen and can no
+	 * longer be modified. Reducing a reduced graph does nothing.
 	 *
 	 * @note The old root node will be part of the new root node.
 	 */
 	void reduce();
 
+	/**
+	 * Build the reduced graph of a grid directly.
+	 *
+	 * Regions of adjacent cells with the same color are labelled in two scans
+	 * over the grid, so no graph with a node per cell is ever created. The
+	 * result is the same as building that graph and reducing it, up to the
+	 * order of neighbors.
+	 *
+	 * @param rows Number of rows of the grid.
+	 * @param columns Number of columns of the grid.
+	 * @param cells Colors of the cells, row by row.
+	 * @param rootIndex Index of the root cell in @p cells.
+	 * @return Reduced graph.
+	 */
+	static Graph fromGrid(unsigned rows, unsigned columns,
+	                      const std::vector<color_t> &cells, unsigned rootIndex);
+
+	/**
+	 * Renumber the nodes in breadth-first order from the root.
+	 *
+	 * The root becomes node 0, and nodes at the same distance from the root
+	 * get consecutive numbers. Neighbors are then mostly close to each other in
+	 * the adjacency array and in bit sets of nodes, which helps the cache.
+	 * Colors keep their numbers. Nodes not connected to the root come last.
+	 *
+	 * @pre The graph has been reduced.
+	 */
+	void renumberBreadthFirst();
+
+	/**
+	 * Has the graph been reduced?
+	 * @return True, if @ref reduce has been called.
+	 */
+	bool isReduced() const { return !offsets.empty(); }
+
 	/**
 	 * Get number of nodes in the graph.
 	 * @return Number of nodes.
 	 */
-	unsigned getNumNodes() const { return nodes.size(); }
+	unsigned getNumNodes() const { return colors.size(); }
+
+	/**
+	 * Get color of a node.
+	 * @param i Index of node.
+	 * @return Color of node @p i.
+	 */
+	color_t getColor(unsigned i) const { return colors[i]; }
+
+	/**
+	 * Get neighbors of a node.
+	 * @pre The graph has been reduced.
+	 * @param i Index of node.
+	 * @return Range of neighbors of node @p i, in no particular order.
+	 */
+	NodeRange getNeighbors(unsigned i) const
+	{
+		assert(isReduced());
+		return {adjacency.data() + offsets[i], adjacency.data() + offsets[i+1]};
+	}
+
+	/**
+	 * Get number of words for a bit set over the nodes.
+	 * @return Number of words.
+	 */
+	unsigned getNumWords() const { return bits::numWords(colors.size()); }
+
+	/**
+	 * Get nodes of a color as bit set.
+	 *
+	 * Moves look at the nodes of their color only through this, one word
+	 * of the frontier at a time, instead of visiting all nodes.
+	 *
+	 * @pre The graph has been reduced.
+	 * @param color Color of the nodes.
+	 * @return Bit set of @ref getNumWords words with the nodes having color
+	 *         @p color.
+	 */
+	const bits::word_t* getColorMask(color_t color) const
+	{
+		assert(isReduced());
+		return colorMasks.data() + color * getNumWords();
+	}
 
 	/**
-	 * Get node by index.
+	 * Get random key of a node for hashing sets of nodes.
+	 * @pre The graph has been reduced.
 	 * @param i Index of node.
-	 * @return Node at index @p i.
+	 * @return Key of node @p i. The hash of a set of nodes is the exclusive
+	 *         or of their keys.
 	 */
-	const Node& operator[](unsigned i) const { return nodes[i]; }
+	std::uint64_t getNodeKey(unsigned i) const { return nodeKeys[i]; }
 
 	/**
 	 * Get a vector that contains the number of nodes for each color.
@@ -71,11 +186,44 @@ public:
 	 */
 	const std::vector<unsigned>& getColorCounts() const { return colorCounts; }
 
+	/**
+	 * Get serial number of the graph.
+	 *
+	 * Graphs get a new number whenever they are reduced or renumbered, so
+	 * caches can tell them apart, even if one is later created at the address
+	 * of another.
+	 *
+	 * @return Serial number, never 0.
+	 */
+	std::uint64_t getSerial() const { return serial; }
+
 private:
-	std::vector<Node> nodes;
+	/// Build adjacency and lookup structures from the edges of reduced nodes.
+	void freeze();
+
+private:
+	std::vector<color_t> colors;
 	unsigned rootIndex;
 
+	// Edges added while building, discarded by freeze().
+	std::vector<std::pair<unsigned, unsigned>> edges;
+
+	// Compressed sparse row layout: the neighbors of node i are stored in
+	// adjacency[offsets[i]] up to adjacency[offsets[i+1]]. Set by freeze().
+	std::vector<unsigned> offsets;
+	std::vector<unsigned> adjacency;
+
+	// Nodes of each color as bit sets, one after another. They take the place
+	// of per-color lists of node indices.
+	std::vector<bits::word_t> colorMasks;
+
+	// Random keys for Zobrist hashing.
+	std::vector<std::uint64_t> nodeKeys;
+
 	std::vector<unsigned> colorCounts;
+
+	// Serial number, assigned by freeze().
+	std::uint64_t serial;
 };
 
 /**
@@ -84,12 +232,13 @@ private:
 class State
 {
 public:
-	using MoveTrie = Trie<color_t>;
+	using MoveTrie = Trie<color_t, MOVE_BITS>;
 
 	/**
 	 * Create initial state based on a graph.
 	 * @param graph Graph to be based on.
 	 * @param trie Data structure to store moves.
+	 * @throw std::runtime_error if moves don't fit into @ref MOVE_BITS bits.
 	 */
 	State(const Graph &graph, MoveTrie &trie);
 
@@ -98,9 +247,12 @@ public:
 	 * @param graph Graph to be based on.
 	 * @param trie Data structure to store moves.
 	 * @param next Color for move.
+	 * @param canonical Reject moves that could as well have been done before
+	 *        the last move. Searches trying all moves need only one order.
 	 * @return True, if the move makes sense.
 	 */
-	bool move(const Graph &graph, MoveTrie &trie, color_t next);
+	bool move(const Graph &graph, MoveTrie &trie, color_t next,
+	          bool canonical = true);
 
 	/**
 	 * Get valuation of the state.
@@ -108,6 +260,12 @@ public:
 	 */
 	unsigned getValuation() const { return valuation; }
 
+	/**
+	 * Get hash of the filled region.
+	 * @return Hash of the filled nodes, independent of the moves.
+	 */
+	std::uint64_t getHash() const { return hash; }
+
 	/**
 	 * Get the number of moves that lead to the state.
 	 * @return Number of moves, including the initial color of node 0.
@@ -126,24 +284,190 @@ public:
 	 */
 	color_t getLastColor() const { return moves.back(); }
 
+	/**
+	 * Get size of records for states.
+	 * @param graph Graph to be based on.
+	 * @return Number of words that @ref save writes.
+	 */
+	static unsigned getRecordSize(const Graph &graph);
+
+	/**
+	 * Save the state into a compact record.
+	 *
+	 * The record contains the filled nodes, the moves and the valuation. The
+	 * frontier and hash are derived from the filled nodes when loading.
+	 *
+	 * @param record Buffer of @ref getRecordSize words.
+	 */
+	void save(bits::word_t *record) const;
+
+	/**
+	 * Load the state from a record.
+	 * @param graph Graph to be based on.
+	 * @param record Buffer written by @ref save.
+	 */
+	void load(const Graph &graph, const bits::word_t *record);
+
+	/**
+	 * Load only the moves from a record.
+	 * @param record Buffer written by @ref save.
+	 * @return Moves that lead to the state.
+	 */
+	static MoveTrie::Sequence loadMoves(const bits::word_t *record);
+
 	/**
 	 * Are we done?
+	 * @param graph Graph to be based on.
 	 * @return True, if all nodes are filled.
 	 */
-	bool done() const;
+	bool done(const Graph &graph) const;
 
 private:
+	/// Compute valuation, starting from the frontier.
 	unsigned computeValuation(const Graph &graph) const;
+	/// Compute valuation from the filled nodes alone, for verification.
+	unsigned computeValuationFromScratch(const Graph &graph) const;
+
+	/// Bit set of filled nodes.
+	bits::word_t* filled() { return words.data(); }
+	const bits::word_t* filled() const { return words.data(); }
+
+	/// Bit set of nodes that are not filled, but adjacent to filled nodes.
+	bits::word_t* frontier() { return words.data() + words.size() / 2; }
+	const bits::word_t* frontier() const
+		{ return words.data() + words.size() / 2; }
 
 private:
-	std::vector<bool> filled;
+	// Bit sets of filled nodes and frontier, in one buffer.
+	std::vector<bits::word_t> words;
 	MoveTrie::Sequence moves;
+	std::uint64_t hash;
 	unsigned valuation;
 };
 
+/**
+ * Beam search to quickly compute a good, but not necessarily the best sequence.
+ *
+ * Keeps the @p beamWidth states with the smallest valuation at every depth.
+ * The result is an upper bound for the best sequence, which the other
+ * algorithms use to prune states.
+ *
+ * By default, this first searches greedily, which is cheap. Only if the
+ * result is far above the valuation of the initial state, the search is
+ * repeated with a wider beam: then the other algorithms take long, and a
+ * tighter bound saves them more than the wider beam costs.
+ *
+ * @param graph Graph to solve.
+ * @param beamWidth Number of states to keep per depth. With 1 this is greedy,
+ *        with 0 greedy first and wider if that's far from optimal.
+ * @return Sequence including the initial color of the root, or an empty
+ *         vector if the graph isn't connected.
+ */
+std::vector<color_t> computeGreedySequence(const Graph &graph,
+                                           unsigned beamWidth = 0);
+
 /**
  * A^* algorithm to compute the best sequence.
  */
 std::vector<color_t> computeBestSequence(const Graph &graph);
 
+/**
+ * A^* algorithm to compute the best sequence within a memory budget.
+ *
+ * If the search runs out of memory, it continues with iterative deepening
+ * from where it was, which is slower, but needs almost no memory.
+ */
+std::vector<color_t> computeBestSequence(const Graph &graph,
+                                         MemoryBudget &budget);
+
+/**
+ * A^* algorithm within a memory budget, with help from idle threads.
+ *
+ * When threads of the pool become idle, the search continues as parallel A^*
+ * (see @ref computeBestSequenceParallel), which they can join. The memory of
+ * all of them is charged to the budget, and if it runs out, the search
+ * continues with iterative deepening.
+ */
+std::vector<color_t> computeBestSequence(const Graph &graph,
+                                         MemoryBudget &budget,
+                                         HelperPool &helpers);
+
+/**
+ * Sequence of moves together with a lower bound for the best sequence.
+ */
+struct BoundedSequence
+{
+	/// Moves, including the initial color of the root.
+	std::vector<color_t> moves;
+	/// Lower bound for the number of moves, not counting the initial color.
+	unsigned lowerBound;
+};
+
+/**
+ * Anytime weighted A^* algorithm to compute a good sequence.
+ *
+ * States are expanded in the order of g + w h, where g is the number of moves
+ * so far and h the lower bound for the moves left. The first sequence found
+ * has at most @p weight times as many moves as the best sequence, not
+ * counting the initial color. If @p improveFor is positive, the search goes
+ * on to find better sequences, until it has proved the best one optimal or
+ * the time is up.
+ *
+ * @param graph Graph to solve.
+ * @param weight Weight w of the lower bound, at least 1, rounded down to
+ *        eighths.
+ * @param improveFor Seconds to keep improving after the first sequence.
+ * @return Best sequence found and a lower bound from the states not expanded.
+ */
+BoundedSequence computeBoundedSequence(const Graph &graph, double weight,
+                                       double improveFor = 0);
+
+/**
+ * Anytime weighted A^* algorithm within a memory budget.
+ *
+ * If the search runs out of memory, it stops and returns the best sequence
+ * found so far, which might not be within the weight then.
+ */
+BoundedSequence computeBoundedSequence(const Graph &graph, double weight,
+                                       double improveFor, MemoryBudget &budget);
+
+/**
+ * External-memory A^* algorithm to compute the best sequence.
+ *
+ * Keeps the open list in a file, bucketed by valuation and number of moves.
+ * Instead of a transposition table, duplicates are dropped by merging the
+ * sorted runs of a bucket when it is expanded. This is slower than A^*, but
+ * needs little memory apart from the buffers and the move trie. The trie
+ * isn't collected, since states on disk refer to it, so it grows with the
+ * number of states generated.
+ *
+ * @param graph Graph to solve.
+ * @param directory Directory for the temporary file.
+ * @param bufferSize Bytes to collect in memory, for all buckets together,
+ *        before writing some of them.
+ */
+std::vector<color_t> computeBestSequenceExternal(
+	const Graph &graph, const std::string &directory,
+	std::size_t bufferSize = 64 << 20);
+
+/**
+ * Iterative deepening A^* algorithm to compute the best sequence.
+ *
+ * Needs memory only linear in the length of the solution, but expands states
+ * repeatedly, for every bound on the valuation.
+ */
+std::vector<color_t> computeBestSequenceIDA(const Graph &graph);
+
+/**
+ * Parallel A^* algorithm to compute the best sequence.
+ *
+ * The states are distributed over the threads by the hash of their filled
+ * region, and every thread has its own open list and transposition table.
+ *
+ * @param graph Graph to solve.
+ * @param numThreads Number of threads to use.
+ */
+std::vector<color_t> computeBestSequenceParallel(
+	const Graph &graph, unsigned numThreads);
+
 #endif
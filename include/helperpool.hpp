@@ -0,0 +1,130 @@
+#ifndef HELPERPOOL_HPP
+#define HELPERPOOL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+/**
+ * Threads that have run out of work of their own, and help with the searches
+ * of others instead.
+ *
+ * Searches check now and then whether there are idle threads. If so, they can
+ * offer to be joined by some of them, and have to withdraw the offer before
+ * they are done.
+ */
+class HelperPool
+{
+public:
+	/// Search that other threads can join.
+	class Search
+	{
+	public:
+		/// Work on the search until it is done. Called by joining threads.
+		virtual void help() = 0;
+
+	protected:
+		~Search() = default;
+	};
+
+	/**
+	 * Create a pool.
+	 * @param numThreads Number of threads that will eventually call @ref help.
+	 */
+	explicit HelperPool(unsigned numThreads)
+		: numThreads(numThreads), idle(0) {}
+
+	HelperPool(const HelperPool&) = delete;
+	HelperPool& operator=(const HelperPool&) = delete;
+
+	/// Number of threads in the pool.
+	unsigned size() const { return numThreads; }
+
+	/// Number of threads waiting for a search to join, for polling.
+	unsigned numIdle() const { return idle.load(std::memory_order_relaxed); }
+
+	/**
+	 * Help with offered searches until all threads of the pool are idle.
+	 *
+	 * Threads with no work of their own left call this, and return when no
+	 * search can be offered anymore.
+	 */
+	void help()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		idle.fetch_add(1, std::memory_order_relaxed);
+		changed.notify_all();
+		while (true) {
+			// Join the search that wants the most helpers.
+			auto offer = std::max_element(offers.begin(), offers.end(),
+				[](const Offer &a, const Offer &b)
+					{ return a.slots < b.slots; });
+			if (offer != offers.end() && offer->slots != 0) {
+				Search *search = offer->search;
+				--offer->slots;
+				++offer->running;
+				idle.fetch_sub(1, std::memory_order_relaxed);
+
+				lock.unlock();
+				search->help();
+				lock.lock();
+
+				--find(*search)->running;
+				idle.fetch_add(1, std::memory_order_relaxed);
+				changed.notify_all();
+			}
+			else if (idle.load(std::memory_order_relaxed) == numThreads)
+				return;
+			else
+				changed.wait(lock);
+		}
+	}
+
+	/**
+	 * Let idle threads join a search.
+	 * @param search Search to join.
+	 * @param slots Number of threads that may join.
+	 */
+	void offer(Search &search, unsigned slots)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		offers.push_back(Offer{&search, slots, 0});
+		changed.notify_all();
+	}
+
+	/// Let no more threads join, and wait until those that did have left.
+	void withdraw(Search &search)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		find(search)->slots = 0;
+		changed.wait(lock, [this, &search]()
+			{ return find(search)->running == 0; });
+		offers.erase(find(search));
+	}
+
+private:
+	struct Offer
+	{
+		Search *search;
+		unsigned slots;                 // Threads that may still join.
+		unsigned running;               // Threads that have joined.
+	};
+
+	std::vector<Offer>::iterator find(const Search &search)
+	{
+		return std::find_if(offers.begin(), offers.end(),
+			[&search](const Offer &offer) { return offer.search == &search; });
+	}
+
+private:
+	const unsigned numThreads;
+	std::atomic<unsigned> idle;         // Changed under the mutex.
+
+	std::mutex mutex;
+	std::condition_variable changed;
+	std::vector<Offer> offers;
+};
+
+#endif
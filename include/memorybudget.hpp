@@ -0,0 +1,90 @@
+#ifndef MEMORYBUDGET_HPP
+#define MEMORYBUDGET_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <limits>
+
+/**
+ * Memory budget for searches, shared by all threads.
+ *
+ * Searches account for the memory of their large data structures, both
+ * against a limit for every single search and against a limit for all of them
+ * together. When a search would exceed either, it has to switch to a strategy
+ * that needs less memory instead of growing further.
+ */
+class MemoryBudget
+{
+public:
+	static constexpr std::size_t UNLIMITED =
+		std::numeric_limits<std::size_t>::max();
+
+	/**
+	 * Create a budget.
+	 * @param limit Bytes that all searches together may use.
+	 * @param searchLimit Bytes that a single search may use.
+	 */
+	explicit MemoryBudget(std::size_t limit = UNLIMITED,
+	                      std::size_t searchLimit = UNLIMITED)
+		: limit(limit), searchLimit(searchLimit), used(0) {}
+
+	/**
+	 * Memory used by a single search, given back when destroyed.
+	 */
+	class Account
+	{
+	public:
+		explicit Account(MemoryBudget &budget) : budget(budget), reserved(0) {}
+		~Account()
+		{
+			budget.used.fetch_sub(reserved, std::memory_order_relaxed);
+		}
+
+		Account(const Account&) = delete;
+		Account& operator=(const Account&) = delete;
+
+		/**
+		 * Update the memory used by the search.
+		 * @param usage Bytes the search is using now.
+		 * @return True, if that is within the budget. Otherwise the account
+		 *         stays as it was, and the search should use less memory.
+		 */
+		bool update(std::size_t usage)
+		{
+			if (usage > budget.searchLimit)
+				return false;
+			if (usage > reserved && !budget.reserve(usage - reserved))
+				return false;
+			if (usage < reserved)
+				budget.used.fetch_sub(reserved - usage,
+				                      std::memory_order_relaxed);
+			reserved = usage;
+			return true;
+		}
+
+	private:
+		MemoryBudget &budget;
+		std::size_t reserved;
+	};
+
+	/// Bytes currently used by all searches together.
+	std::size_t getUsed() const { return used.load(std::memory_order_relaxed); }
+
+private:
+	bool reserve(std::size_t bytes)
+	{
+		// We never exceed the limit, so limit - current doesn't overflow.
+		std::size_t current = used.load(std::memory_order_relaxed);
+		do {
+			if (bytes > limit - current)
+				return false;
+		} while (!used.compare_exchange_weak(current, current + bytes,
+		                                     std::memory_order_relaxed));
+		return true;
+	}
+
+	const std::size_t limit, searchLimit;
+	std::atomic<std::size_t> used;
+};
+
+#endif
@@ -2,14 +2,24 @@
 #define TRIE_HPP
 
 #include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <deque>
 
 /**
  * Data structure for efficient storage of move histories.
+ *
+ * Elements are stored with @p Bits bits each. By default that's the size of
+ * @p T, but smaller integers can be packed into fewer bits: then @p Bits must
+ * divide 8, and elements must fit into it.
  */
-template<typename T>
+template<typename T, unsigned Bits = 8 * sizeof(T)>
 class Trie
 {
+	static_assert(Bits == 8 * sizeof(T) || (Bits < 8 && 8 % Bits == 0),
+	              "Elements must take whole bytes or evenly divide them");
+
 private:
 	/**
 	 * Block containing elements of the trie.
@@ -19,6 +29,8 @@ private:
 	 */
 	class Block
 	{
+		friend Trie;
+
 	public:
 		Block() : pred(nullptr), length(0) {}
 		explicit Block(const Block *predecessor)
@@ -29,49 +41,89 @@ private:
 		/// @return True, if data block is full.
 		bool add(const T &t) {
 			unsigned index = length % ELEMENTS_PER_BLOCK;
-			data[index] = t;
+			set(index, t);
 			++length;
 			return index == ELEMENTS_PER_BLOCK-1;
 		}
 
-		const T& back() const
+		T back() const
 		{
 			assert(length != 0);
 			unsigned last = (length-1) % ELEMENTS_PER_BLOCK;
 			if (last != ELEMENTS_PER_BLOCK-1)
-				return data[last];
+				return get(last);
 			else
-				return pred->data[ELEMENTS_PER_BLOCK-1];
+				return pred->get(ELEMENTS_PER_BLOCK-1);
 		}
 
 		void materialize(T *buffer) const
 		{
 			unsigned offset = length - ((length-1) % ELEMENTS_PER_BLOCK + 1);
 			for (unsigned index = 0; offset + index < length; ++index)
-				buffer[offset + index] = data[index];
+				buffer[offset + index] = get(index);
 			if (pred)
 				pred->materialize(buffer);
 		}
 
+	private:
+		// While collecting garbage, the lowest bit of the predecessor pointer
+		// of stored blocks marks them as reachable. Otherwise it's clear.
+		bool marked() const
+		{
+			return reinterpret_cast<std::uintptr_t>(pred) & 1;
+		}
+		void setMarked(bool mark)
+		{
+			std::uintptr_t bits = reinterpret_cast<std::uintptr_t>(pred);
+			pred = reinterpret_cast<const Block*>((bits & ~std::uintptr_t(1))
+				| std::uintptr_t(mark));
+		}
+
+		T get(unsigned index) const
+		{
+			if (PACKED) {
+				unsigned shift = index * Bits % 8;
+				return static_cast<T>((data[index * Bits / 8] >> shift) & MASK);
+			}
+			T t;
+			std::memcpy(&t, data + index * sizeof(T), sizeof(T));
+			return t;
+		}
+
+		void set(unsigned index, const T &t)
+		{
+			if (PACKED) {
+				assert((static_cast<unsigned>(t) & ~MASK) == 0);
+				unsigned char &byte = data[index * Bits / 8];
+				unsigned shift = index * Bits % 8;
+				byte &= ~(MASK << shift);
+				byte |= static_cast<unsigned>(t) << shift;
+			}
+			else
+				std::memcpy(data + index * sizeof(T), &t, sizeof(T));
+		}
+
 	private:
 		const Block *pred;      // Predecessor block; nullptr if none.
 		unsigned short length;  // Length of sequence including predecessors.
 
 		// We want to use 2*sizeof(void*) per block.
-		static constexpr unsigned ELEMENTS_PER_BLOCK =
-			(sizeof(void*) - sizeof length) / sizeof(T);
-		T data[ELEMENTS_PER_BLOCK];
+		static constexpr unsigned DATA_BYTES = sizeof(void*) - sizeof length;
+		static constexpr unsigned ELEMENTS_PER_BLOCK = DATA_BYTES * 8 / Bits;
+		static constexpr bool PACKED = Bits < 8;
+		static constexpr unsigned MASK = (1u << Bits % 8) - 1;  // If packed.
+		unsigned char data[DATA_BYTES];
 	};
 
 public:
 	// Wrap blocks so that only we can append elements.
 	class Sequence
 	{
-		friend Trie<T>;
+		friend Trie;
 		Sequence(Block block) : block(block) {}
 
 	public:
-		const T& back() const { return block.back(); }
+		T back() const { return block.back(); }
 		unsigned size() const { return block.size(); }
 		void materialize(T *buffer) const { return block.materialize(buffer); }
 
@@ -79,22 +131,113 @@ public:
 		Block block;
 	};
 
+	/// Number of blocks in use and allocated, see @ref getStats.
+	struct Stats
+	{
+		std::size_t liveBlocks;
+		std::size_t totalBlocks;
+	};
+
+	Trie() : freeList(nullptr), numFree(0) {}
+
 	static Sequence initial() { return Block{}; }
 
 	Sequence append(Sequence sequence, const T &element)
 	{
 		if (sequence.block.add(element)) {
-			blocks.push_back(sequence.block);
-			return Block{&blocks.back()};
+			Block *stored = freeList;
+			if (stored) {
+				freeList = const_cast<Block*>(stored->pred);
+				--numFree;
+				*stored = sequence.block;
+			}
+			else {
+				blocks.push_back(sequence.block);
+				stored = &blocks.back();
+			}
+			return Block{stored};
 		}
 		else
 			return sequence;
 	}
 
+	/**
+	 * Mark a sequence as still in use, before calling @ref sweep.
+	 * @param sequence Sequence that must stay valid.
+	 */
+	void markLive(const Sequence &sequence)
+	{
+		// We can stop at marked blocks, their predecessors are marked already.
+		Block *block = const_cast<Block*>(sequence.block.pred);
+		while (block && !block->marked()) {
+			Block *pred = const_cast<Block*>(block->pred);
+			block->setMarked(true);
+			block = pred;
+		}
+	}
+
+	/**
+	 * Reclaim the storage of sequences that are no longer in use.
+	 *
+	 * Sequences are plain values, so we can't know which are still in use.
+	 * Instead they have to be passed to @ref markLive before, and storage that
+	 * none of them needs is reused by later appends. All other sequences become
+	 * invalid.
+	 */
+	void sweep()
+	{
+		// Free blocks are linked through their predecessor pointer.
+		freeList = nullptr;
+		numFree = 0;
+		for (Block &block : blocks) {
+			if (block.marked())
+				block.setMarked(false);
+			else {
+				block.pred = freeList;
+				freeList = &block;
+				++numFree;
+			}
+		}
+	}
+
+	/**
+	 * Get statistics about the storage.
+	 *
+	 * Blocks are live unless @ref sweep has found them unused and they haven't
+	 * been reused since.
+	 */
+	Stats getStats() const { return {blocks.size() - numFree, blocks.size()}; }
+
+	/**
+	 * Get a mark for the current size of the trie.
+	 * @return Mark to pass to @ref rewind.
+	 */
+	std::size_t mark() const { return blocks.size(); }
+
+	/**
+	 * Release all storage that was added since @p mark was obtained.
+	 *
+	 * Sequences that have been appended to since then become invalid, others
+	 * stay valid. This allows depth-first searches to use the trie as stack.
+	 * It can't be combined with @ref sweep, which reuses blocks anywhere.
+	 */
+	void rewind(std::size_t mark)
+	{
+		assert(numFree == 0);
+		blocks.resize(mark);
+	}
+
+	/// Bytes used by the blocks of the trie.
+	std::size_t memoryUsage() const { return blocks.size() * sizeof(Block); }
+
 private:
 	// Append-only queue of data blocks.
 	static_assert(sizeof(Block) == 2*sizeof(void*), "Elements are too big");
 	std::deque<Block> blocks;
+
+	// Blocks that can be reused, linked through their predecessor pointer.
+	Block *freeList;
+	std::size_t numFree;
 };
 
 #endif
@@ -0,0 +1,138 @@
+#ifndef BUCKETQUEUE_HPP
+#define BUCKETQUEUE_HPP
+
+#include <cassert>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+/**
+ * Bucket priority queue for small integer priorities.
+ *
+ * Elements are ordered by smallest key first, and among those with the same
+ * key by largest depth first. There is one bucket for every combination of
+ * key and depth; elements in the same bucket are taken in first-in first-out
+ * order. Push and pop take amortized constant time, apart from skipping empty
+ * buckets.
+ *
+ * Buckets are vectors, so that we know exactly how much memory they take, even
+ * if there are many buckets with few elements. A bucket gives its memory back
+ * when it runs empty.
+ */
+template<typename T>
+class BucketQueue
+{
+public:
+	BucketQueue() : minKey(0), numElements(0), bucketBytes(0) {}
+
+	bool empty() const { return numElements == 0; }
+	std::size_t size() const { return numElements; }
+
+	/// No element has a smaller key than this.
+	unsigned lowestKey() const { return minKey; }
+
+	/// Number of bytes used by the elements and buckets.
+	std::size_t memoryUsage() const
+	{
+		return rows.capacity() * sizeof(Row) + bucketBytes;
+	}
+
+	/**
+	 * Add an element.
+	 * @param key Primary priority, smaller is better.
+	 * @param depth Secondary priority, larger is better.
+	 * @param element Element to add.
+	 */
+	void push(unsigned key, unsigned depth, T &&element)
+	{
+		if (key >= rows.size())
+			rows.resize(key + 1);
+		Row &row = rows[key];
+		if (depth >= row.buckets.size()) {
+			bucketBytes -= row.buckets.capacity() * sizeof(Bucket);
+			row.buckets.resize(depth + 1);
+			bucketBytes += row.buckets.capacity() * sizeof(Bucket);
+		}
+		Bucket &bucket = row.buckets[depth];
+		std::vector<T> &elements = bucket.elements;
+		if (elements.size() == elements.capacity() &&
+		    2 * bucket.head >= elements.size()) {
+			// Rather than growing, drop the elements taken so far.
+			elements.erase(elements.begin(), elements.begin() + bucket.head);
+			bucket.head = 0;
+		}
+		bucketBytes -= elements.capacity() * sizeof(T);
+		elements.push_back(std::move(element));
+		bucketBytes += elements.capacity() * sizeof(T);
+
+		if (empty() || key < minKey)
+			minKey = key;
+		if (row.size++ == 0 || depth > row.maxDepth)
+			row.maxDepth = depth;
+		++numElements;
+	}
+
+	/// Call a function with every element, in no particular order.
+	template<typename Function>
+	void forEach(Function function) const
+	{
+		for (const Row &row : rows)
+			for (const Bucket &bucket : row.buckets)
+				for (std::size_t index = bucket.head;
+				     index != bucket.elements.size(); ++index)
+					function(bucket.elements[index]);
+	}
+
+	/**
+	 * Remove the element with the best priority.
+	 * @pre The queue is not empty.
+	 * @return The removed element.
+	 */
+	T pop()
+	{
+		assert(!empty());
+		while (rows[minKey].size == 0)
+			++minKey;
+		Row &row = rows[minKey];
+		while (row.buckets[row.maxDepth].empty())
+			--row.maxDepth;
+
+		Bucket &bucket = row.buckets[row.maxDepth];
+		T element = std::move(bucket.elements[bucket.head++]);
+		if (bucket.empty()) {
+			// Give the memory back.
+			bucketBytes -= bucket.elements.capacity() * sizeof(T);
+			std::vector<T>().swap(bucket.elements);
+			bucket.head = 0;
+		}
+		--row.size;
+		--numElements;
+		return element;
+	}
+
+private:
+	// Elements with the same key and depth. Those before the head have been
+	// taken already.
+	struct Bucket
+	{
+		std::vector<T> elements;
+		std::size_t head = 0;
+
+		bool empty() const { return head == elements.size(); }
+	};
+
+	// All elements with the same key, bucketed by depth.
+	struct Row
+	{
+		std::vector<Bucket> buckets;
+		std::size_t size = 0;       // Number of elements in all buckets.
+		unsigned maxDepth = 0;      // No larger depth has elements.
+	};
+
+	std::vector<Row> rows;
+	unsigned minKey;                // No smaller key has elements.
+	std::size_t numElements;
+	std::size_t bucketBytes;        // Capacity of the buckets of all rows.
+};
+
+#endif
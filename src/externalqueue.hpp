@@ -0,0 +1,325 @@
+#ifndef EXTERNALQUEUE_HPP
+#define EXTERNALQUEUE_HPP
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "floodit.hpp"
+
+/**
+ * Priority queue for states on disk, for searches that don't fit into memory.
+ *
+ * States are put into buckets by key and depth, and buckets are taken as a
+ * whole: smallest key first, and among those largest depth first, like in
+ * @ref BucketQueue. Children are one move deeper than their parent, so they
+ * never go into the bucket that is currently being taken. But they can go into
+ * a bucket that has already been taken, which is then taken again later.
+ *
+ * Every bucket collects fixed-size records of the hash and the state (see
+ * State::save) in memory. When all buckets together have more than the buffer
+ * size, the one with the most records is sorted by hash and appended to the
+ * file as a run. The runs of all buckets share a single file. When a bucket is
+ * taken, its runs are mapped into memory and merged, which brings states with
+ * the same filled region together, so we can drop duplicates. States in the
+ * same bucket with the same region have the same number of moves, so it
+ * doesn't matter which one we keep. Duplicates in different buckets aren't
+ * detected. Once a bucket is done, the space of its runs is given back to the
+ * file system where that is supported.
+ */
+class ExternalQueue
+{
+public:
+	/**
+	 * Create an empty queue.
+	 * @param graph Graph to be based on.
+	 * @param directory Directory for the file. It is deleted right after
+	 *        creating it, so nothing is left behind.
+	 * @param bufferSize Bytes that all buckets together may collect before
+	 *        one of them is written. Sorting and the bucket being taken need
+	 *        about as much again.
+	 */
+	ExternalQueue(const Graph &graph, std::string directory,
+	              std::size_t bufferSize)
+		: graph(graph), directory(std::move(directory)),
+		  recordSize(1 + State::getRecordSize(graph)),
+		  bufferWords(std::max<std::size_t>(recordSize,
+			bufferSize / sizeof(bits::word_t))),
+		  pageSize(sysconf(_SC_PAGESIZE)) {}
+
+	~ExternalQueue()
+	{
+		close();
+		if (file != -1)
+			::close(file);
+	}
+
+	ExternalQueue(const ExternalQueue&) = delete;
+	ExternalQueue& operator=(const ExternalQueue&) = delete;
+
+	/**
+	 * Add a state.
+	 * @param key Primary priority, smaller is better.
+	 * @param depth Secondary priority, larger is better. Must be different from
+	 *        the depth of the bucket that is currently being taken, if the key
+	 *        is the same.
+	 * @param state State to add.
+	 */
+	void push(unsigned key, unsigned depth, const State &state)
+	{
+		Bucket &bucket = buckets[std::make_pair(key, depth)];
+		std::size_t offset = bucket.buffer.size();
+		bucket.buffer.resize(offset + recordSize);
+		bucket.buffer[offset] = state.getHash();
+		state.save(&bucket.buffer[offset + 1]);
+
+		buffered += recordSize;
+		if (buffered > bufferWords)
+			writeRun(largestBucket());
+	}
+
+	/**
+	 * Remove a state with the best priority, dropping duplicates.
+	 * @param state State to overwrite with the removed state.
+	 * @return False, if the queue is empty.
+	 */
+	bool pop(State &state)
+	{
+		const bits::word_t *record;
+		while (!(record = next())) {
+			if (buckets.empty())
+				return false;
+			open();
+		}
+
+		state.load(graph, record + 1);
+		return true;
+	}
+
+private:
+	/// Sorted records in the file.
+	struct Run
+	{
+		off_t offset;                       // In bytes.
+		std::size_t numRecords;
+	};
+
+	/// States with the same key and depth.
+	struct Bucket
+	{
+		std::vector<bits::word_t> buffer;   // Records not written yet.
+		std::vector<Run> runs;              // In the order of their offsets.
+	};
+
+	/// Order of buckets: smallest key first, then largest depth.
+	struct BucketOrder
+	{
+		bool operator()(std::pair<unsigned, unsigned> a,
+		                std::pair<unsigned, unsigned> b) const
+		{
+			return a.first != b.first ? a.first < b.first : a.second > b.second;
+		}
+	};
+
+	/// Records of a sorted run that haven't been merged yet.
+	struct Span
+	{
+		const bits::word_t *begin, *end;
+	};
+
+	/// Sort the records of a buffer by hash, and drop duplicates.
+	void sortRecords(std::vector<bits::word_t> &buffer)
+	{
+		std::size_t numRecords = buffer.size() / recordSize;
+		order.resize(numRecords);
+		for (std::size_t index = 0; index != numRecords; ++index)
+			order[index] = index;
+		std::sort(order.begin(), order.end(),
+			[&buffer, this](std::size_t a, std::size_t b)
+				{ return buffer[a * recordSize] < buffer[b * recordSize]; });
+
+		sorted.clear();
+		for (std::size_t index : order) {
+			const bits::word_t *record = &buffer[index * recordSize];
+			if (sorted.empty() ||
+			    sorted[sorted.size() - recordSize] != record[0])
+				sorted.insert(sorted.end(), record, record + recordSize);
+		}
+		buffer.swap(sorted);
+	}
+
+	/// @return The bucket with the most records in memory.
+	Bucket& largestBucket()
+	{
+		return std::max_element(buckets.begin(), buckets.end(),
+			[](const std::pair<const std::pair<unsigned, unsigned>, Bucket> &a,
+			   const std::pair<const std::pair<unsigned, unsigned>, Bucket> &b)
+				{ return a.second.buffer.size() < b.second.buffer.size(); }
+			)->second;
+	}
+
+	/// Append the buffer of a bucket to the file as a sorted run.
+	void writeRun(Bucket &bucket)
+	{
+		buffered -= bucket.buffer.size();
+		sortRecords(bucket.buffer);
+		if (file == -1) {
+			std::string path = directory + "/floodit-XXXXXX";
+			file = mkstemp(&path[0]);
+			if (file == -1)
+				throw std::system_error(errno, std::generic_category(),
+					"Could not create file in " + directory);
+			unlink(path.c_str());
+		}
+
+		Run run{fileSize, bucket.buffer.size() / recordSize};
+		const char *data = reinterpret_cast<const char*>(bucket.buffer.data());
+		std::size_t size = bucket.buffer.size() * sizeof(bits::word_t);
+		while (size > 0) {
+			ssize_t written = pwrite(file, data, size, fileSize);
+			if (written == -1) {
+				if (errno == EINTR)
+					continue;
+				throw std::system_error(errno, std::generic_category(),
+				                        "Could not write run");
+			}
+			data += written;
+			size -= written;
+			fileSize += written;
+		}
+
+		// Give the memory back, the bucket might not get more records.
+		bucket.runs.push_back(run);
+		std::vector<bits::word_t>().swap(bucket.buffer);
+	}
+
+	/// Start merging the runs of the best bucket.
+	void open()
+	{
+		close();
+		auto it = buckets.begin();
+		Bucket bucket = std::move(it->second);
+		buckets.erase(it);
+		buffered -= bucket.buffer.size();
+
+		// Map the part of the file with the runs, the rest stays in memory.
+		// Runs of other buckets in between are mapped, but not read.
+		if (!bucket.runs.empty()) {
+			const Run &last = bucket.runs.back();
+			off_t begin = bucket.runs.front().offset / pageSize * pageSize;
+			off_t end = last.offset + static_cast<off_t>(
+				last.numRecords * recordSize * sizeof(bits::word_t));
+			mappingSize = end - begin;
+			mapping = mmap(nullptr, mappingSize, PROT_READ, MAP_PRIVATE,
+			               file, begin);
+			if (mapping == MAP_FAILED) {
+				mapping = nullptr;
+				throw std::system_error(errno, std::generic_category(),
+				                        "Could not map runs");
+			}
+
+			const char *base = static_cast<const char*>(mapping);
+			for (const Run &run : bucket.runs) {
+				auto first = reinterpret_cast<const bits::word_t*>(
+					base + (run.offset - begin));
+				spans.push_back({first, first + run.numRecords * recordSize});
+			}
+			runs.swap(bucket.runs);
+		}
+
+		sortRecords(bucket.buffer);
+		remainder.swap(bucket.buffer);
+		if (!remainder.empty())
+			spans.push_back({remainder.data(),
+			                 remainder.data() + remainder.size()});
+
+		std::make_heap(spans.begin(), spans.end(), compare);
+		haveLast = false;
+	}
+
+	/// Stop merging the current bucket, and free the space of its runs.
+	void close()
+	{
+		spans.clear();
+		std::vector<bits::word_t>().swap(remainder);
+		if (mapping)
+			munmap(mapping, mappingSize);
+		mapping = nullptr;
+
+#ifdef FALLOC_FL_PUNCH_HOLE
+		// If the file system can't do this, the space stays until the end.
+		for (const Run &run : runs)
+			fallocate(file, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+			          run.offset, run.numRecords * recordSize *
+			                      sizeof(bits::word_t));
+#endif
+		runs.clear();
+	}
+
+	/// @return Next record of the current bucket, or nullptr if there is none.
+	const bits::word_t* next()
+	{
+		while (!spans.empty()) {
+			std::pop_heap(spans.begin(), spans.end(), compare);
+			Span &span = spans.back();
+			const bits::word_t *record = span.begin;
+			span.begin += recordSize;
+			if (span.begin == span.end)
+				spans.pop_back();
+			else
+				std::push_heap(spans.begin(), spans.end(), compare);
+
+			if (!haveLast || record[0] != lastHash) {
+				haveLast = true;
+				lastHash = record[0];
+				return record;
+			}
+		}
+
+		return nullptr;
+	}
+
+	/// Heap order: the span with the smallest hash comes first.
+	static bool compare(const Span &a, const Span &b)
+	{
+		return *a.begin > *b.begin;
+	}
+
+private:
+	const Graph &graph;
+	const std::string directory;
+	const unsigned recordSize;          // In words.
+	const std::size_t bufferWords;      // For the buffers of all buckets.
+	const off_t pageSize;
+
+	// Buckets by key and depth, except the current.
+	std::map<std::pair<unsigned, unsigned>, Bucket, BucketOrder> buckets;
+	std::size_t buffered = 0;           // Words in their buffers.
+
+	// File with the runs of all buckets, or -1 if nothing was written yet.
+	int file = -1;
+	off_t fileSize = 0;
+
+	// The current bucket: its mapped runs and the records left in memory.
+	std::vector<Run> runs;
+	void *mapping = nullptr;
+	std::size_t mappingSize = 0;
+	std::vector<bits::word_t> remainder;
+	std::vector<Span> spans;            // Heap of runs to merge.
+	bits::word_t lastHash;
+	bool haveLast = false;
+
+	// Scratch space for sorting.
+	std::vector<std::size_t> order;
+	std::vector<bits::word_t> sorted;
+};
+
+#endif
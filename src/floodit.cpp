@@ -11,18 +11,35 @@
 #include "floodit.hpp"
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <deque>
+#include <limits>
+#include <numeric>
 #include <stdexcept>
+#include <type_traits>
 #include <utility>
+#include "bucketqueue.hpp"
+#include "externalqueue.hpp"
+#include "parallel.hpp"
+#include "statearena.hpp"
+#include "transposition.hpp"
 #include "unionfind.hpp"
 
+/// Placeholder for node numbers that haven't been assigned yet.
+static const unsigned NONE = -1;
+
 Graph::Graph(unsigned numNodes)
-	: nodes(numNodes), rootIndex(0), colorCounts(1, numNodes) {}
+	: colors(numNodes, 0), rootIndex(0), colorCounts(1, numNodes), serial(0) {}
 
 void Graph::setColor(unsigned index, color_t color)
 {
-	--colorCounts[nodes[index].color];
-	nodes[index].color = color;
+	assert(!isReduced());
+	--colorCounts[colors[index]];
+	colors[index] = color;
 
 	if (color >= colorCounts.size())
 		colorCounts.resize(color+1);
@@ -31,172 +48,348 @@ void Graph::setColor(unsigned index, color_t color)
 
 void Graph::addEdge(unsigned a, unsigned b)
 {
-	nodes[a].neighbors.push_back(b);
-	nodes[b].neighbors.push_back(a);
+	assert(!isReduced());
+	edges.emplace_back(a, b);
 }
 
 void Graph::reduce()
 {
+	if (isReduced())
+		return;
+
 	// If a node has the same color as a neighbor, merge them.
-	UnionFind partitions(nodes.size());
-	for (unsigned i = 0; i < nodes.size(); ++i)
-		for (unsigned neighbor : nodes[i].neighbors)
-			if (nodes[i].color == nodes[neighbor].color)
-				partitions.merge(i, neighbor);
-
-	// Create a map for renumbering the nodes. Update color counts.
-	std::vector<unsigned> reduced(nodes.size(), 0);
-	for (unsigned i = 1; i < nodes.size(); ++i) {
-		assert(partitions.find(i) <= i);
-		reduced[i] = reduced[i-1] + (partitions.find(i) == i);
-		if (partitions.find(i) != i)
-			--colorCounts[nodes[i].color];
+	UnionFind partitions(colors.size());
+	for (std::pair<unsigned, unsigned> edge : edges)
+		if (colors[edge.first] == colors[edge.second])
+			partitions.merge(edge.first, edge.second);
+
+	// Number the merged nodes in the order of their first original node, and
+	// map every original node to its number. The number of a merged node is
+	// stored at its representative, until the representative itself is mapped.
+	// Compact the colors as we go and update color counts.
+	std::vector<unsigned> reduced(colors.size(), NONE);
+	unsigned numNodes = 0;
+	for (unsigned i = 0; i < colors.size(); ++i) {
+		unsigned representative = partitions.find(i);
+		if (reduced[representative] == NONE) {
+			reduced[representative] = numNodes;
+			colors[numNodes++] = colors[i];
+		}
+		else
+			--colorCounts[colors[i]];
+		reduced[i] = reduced[representative];
 	}
 
 	// Update root index.
-	rootIndex = reduced[partitions.find(rootIndex)];
-
-	// Now we merge the neighbor lists.
-	for (unsigned i = 0; i < nodes.size(); ++i) {
-		unsigned parentId = partitions.find(i);
-		if (parentId != i) {
-			Node &parent = nodes[parentId], &node = nodes[i];
-			parent.neighbors.insert(parent.neighbors.end(),
-				node.neighbors.begin(), node.neighbors.end());
-		}
+	rootIndex = reduced[rootIndex];
+
+	// Translate edges to the reduced nodes.
+	for (std::pair<unsigned, unsigned> &edge : edges) {
+		edge.first = reduced[edge.first];
+		edge.second = reduced[edge.second];
 	}
 
 	// We remove all other nodes.
-	for (unsigned i = 0; i < nodes.size(); ++i)
-		if (partitions.find(i) == i)
-			nodes[reduced[i]] = nodes[i];
+	colors.resize(numNodes);
+	colors.shrink_to_fit();
 
-	nodes.resize(reduced.back() + 1);
+	freeze();
+}
 
-	// Now we remap the neighbors and eliminate duplicates.
-	for (unsigned i = 0; i < nodes.size(); ++i) {
-		std::vector<unsigned> &neighbors = nodes[i].neighbors;
-		std::transform(neighbors.begin(), neighbors.end(), neighbors.begin(),
-			[&reduced, &partitions](unsigned n)
-			{
-				return reduced[partitions.find(n)];
+Graph Graph::fromGrid(unsigned rows, unsigned columns,
+                      const std::vector<color_t> &cells, unsigned rootIndex)
+{
+	assert(cells.size() == rows * columns);
+
+	// First scan: give every cell a provisional label. A cell continues the
+	// region of its left or upper neighbor if it has the same color. If it
+	// continues both, their labels are equivalent.
+	std::vector<unsigned> labels(cells.size());
+	std::vector<color_t> labelColors;
+	UnionFind equivalent(cells.size());
+	for (unsigned i = 0; i < rows; ++i) {
+		for (unsigned j = 0; j < columns; ++j) {
+			unsigned index = i * columns + j;
+			bool left = j > 0 && cells[index - 1] == cells[index];
+			bool up = i > 0 && cells[index - columns] == cells[index];
+			if (left) {
+				labels[index] = labels[index - 1];
+				if (up && labels[index - columns] != labels[index])
+					equivalent.merge(labels[index - columns], labels[index]);
 			}
-		);
+			else if (up)
+				labels[index] = labels[index - columns];
+			else {
+				labels[index] = labelColors.size();
+				labelColors.push_back(cells[index]);
+			}
+		}
+	}
 
-		auto end = std::remove(neighbors.begin(), neighbors.end(), i);
-		std::sort(neighbors.begin(), end);
-		end = std::unique(neighbors.begin(), end);
-		neighbors.erase(end, neighbors.end());
+	// Number the regions in the order of their first label, which is the order
+	// of their first cell, just like reduce() does.
+	Graph graph(0);
+	std::vector<unsigned> reduced(labelColors.size(), NONE);
+	for (unsigned label = 0; label < labelColors.size(); ++label) {
+		unsigned representative = equivalent.find(label);
+		if (reduced[representative] == NONE) {
+			reduced[representative] = graph.colors.size();
+			color_t color = labelColors[label];
+			graph.colors.push_back(color);
+			if (color >= graph.colorCounts.size())
+				graph.colorCounts.resize(color + 1);
+			++graph.colorCounts[color];
+		}
+		reduced[label] = reduced[representative];
 	}
 
-	// Check that we (still) have all colors.
-	unsigned numColors =
-		std::count_if(colorCounts.begin(), colorCounts.end(),
-			[](unsigned i) { return i > 0; });
-	if (numColors != colorCounts.size())
-		throw std::runtime_error("We have no nodes for some colors");
+	// Second scan: replace labels by region numbers and collect the edges
+	// between regions. Along a border between two regions, we only take the
+	// first of the parallel edges.
+	for (unsigned i = 0; i < rows; ++i) {
+		for (unsigned j = 0; j < columns; ++j) {
+			unsigned index = i * columns + j;
+			unsigned node = labels[index] = reduced[labels[index]];
+			if (j > 0 && labels[index - 1] != node &&
+			    !(i > 0 && labels[index - columns] == node &&
+			      labels[index - columns - 1] == labels[index - 1]))
+				graph.edges.emplace_back(labels[index - 1], node);
+			if (i > 0 && labels[index - columns] != node &&
+			    !(j > 0 && labels[index - 1] == node &&
+			      labels[index - columns - 1] == labels[index - columns]))
+				graph.edges.emplace_back(labels[index - columns], node);
+		}
+	}
+
+	graph.rootIndex = labels[rootIndex];
+	graph.freeze();
+	return graph;
 }
 
-State::State(const Graph &graph, MoveTrie &trie)
-	: filled(graph.getNumNodes(), false)
-	, moves(trie.append(MoveTrie::initial(),
-		graph[graph.getRootIndex()].color))
+void Graph::renumberBreadthFirst()
 {
-	// Check that the graph is reduced. We are going to assume that later.
-	for (unsigned index = 0; index < graph.getNumNodes(); ++index) {
-		const Graph::Node &node = graph[index];
-		for (unsigned neighbor : node.neighbors)
-			assert(node.color != graph[neighbor].color);
+	assert(isReduced());
+	unsigned numNodes = colors.size();
+
+	// Visit the nodes breadth-first, the queue being the new order.
+	std::vector<unsigned> order, renumbered(numNodes, NONE);
+	order.reserve(numNodes);
+	auto visit = [&](unsigned node) {
+		if (renumbered[node] == NONE) {
+			renumbered[node] = order.size();
+			order.push_back(node);
+		}
+	};
+	visit(rootIndex);
+	for (unsigned next = 0, unreached = 0; next != numNodes; ++next) {
+		// Nodes that can't be reached come in their old order.
+		if (next == order.size()) {
+			while (renumbered[unreached] != NONE)
+				++unreached;
+			visit(unreached);
+		}
+		for (unsigned neighbor : getNeighbors(order[next]))
+			visit(neighbor);
 	}
 
-	filled[graph.getRootIndex()] = true;
-	valuation = computeValuation(graph);
+	// Collect the edges in the new numbering, each once, and rebuild.
+	std::vector<color_t> oldColors(std::move(colors));
+	colors.resize(numNodes);
+	for (unsigned node = 0; node != numNodes; ++node) {
+		colors[node] = oldColors[order[node]];
+		for (unsigned neighbor : getNeighbors(order[node]))
+			if (node < renumbered[neighbor])
+				edges.emplace_back(node, renumbered[neighbor]);
+	}
+	rootIndex = 0;
+
+	freeze();
 }
 
-bool State::move(const Graph &graph, MoveTrie &trie, color_t next)
+void Graph::freeze()
 {
-	assert(next != moves.back());
-
-	color_t last = moves.back();
-	moves = trie.append(moves, next);
+	unsigned numNodes = colors.size();
 
-	if (next > last) {
-		// Does the move change anything?
-		bool expansion = false;
-		for (unsigned node = 0; node < filled.size(); ++node) {
-			if (graph[node].color == next && !filled[node]) {
-				for(unsigned neighbor : graph[node].neighbors) {
-					if (filled[neighbor]) {
-						filled[node] = true;
-						expansion = true;
-					}
-				}
-			}
+	// Count the neighbors of each node and compute the offsets. Edges within
+	// a merged node are dropped.
+	offsets.assign(numNodes + 1, 0);
+	for (std::pair<unsigned, unsigned> edge : edges) {
+		if (edge.first != edge.second) {
+			++offsets[edge.first + 1];
+			++offsets[edge.second + 1];
 		}
+	}
+	std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
 
-		if (!expansion)
-			return false;
+	// Scatter the edges into the adjacency array.
+	adjacency.resize(offsets.back());
+	std::vector<unsigned> position(offsets.begin(), offsets.end() - 1);
+	for (std::pair<unsigned, unsigned> edge : edges) {
+		if (edge.first != edge.second) {
+			adjacency[position[edge.first]++] = edge.second;
+			adjacency[position[edge.second]++] = edge.first;
+		}
 	}
-	else {
-		// Does the move change anything that couldn't have happened before?
-		bool additionalExpansion = false;
-		for (unsigned node = 0; node < filled.size(); ++node) {
-			if (graph[node].color == next && !filled[node]) {
-				// Was any of the neighbors filled before the last move?
-				bool prev = false;
-				for (unsigned neighbor : graph[node].neighbors) {
-					if (filled[neighbor]) {
-						filled[node] = true;
-						if (graph[neighbor].color != last)
-							prev = true;
-					}
-				}
-				if (filled[node] && !prev)
-					additionalExpansion = true;
+	std::vector<std::pair<unsigned, unsigned>>().swap(edges);
+
+	// Now we eliminate duplicate neighbors, compacting the adjacency array as
+	// we go. A neighbor has already been seen for this node if its stamp is the
+	// node's index.
+	std::vector<unsigned> stamp(numNodes, NONE);
+	unsigned size = 0;
+	for (unsigned i = 0; i < numNodes; ++i) {
+		unsigned begin = offsets[i], end = offsets[i+1];
+		offsets[i] = size;
+		for (unsigned k = begin; k != end; ++k) {
+			unsigned neighbor = adjacency[k];
+			if (stamp[neighbor] != i) {
+				stamp[neighbor] = i;
+				adjacency[size++] = neighbor;
 			}
 		}
+	}
+	offsets[numNodes] = size;
+	adjacency.resize(size);
+	adjacency.shrink_to_fit();
 
-		if (!additionalExpansion)
-			return false;
+	// Group the nodes by color.
+	colorMasks.assign(colorCounts.size() * getNumWords(), 0);
+	for (unsigned i = 0; i < numNodes; ++i)
+		bits::set(colorMasks.data() + colors[i] * getNumWords(), i);
+
+	// Generate keys for hashing with SplitMix64. It doesn't need to be
+	// unpredictable, so we use a fixed seed.
+	nodeKeys.resize(numNodes);
+	std::uint64_t seed = 0;
+	for (std::uint64_t &key : nodeKeys) {
+		key = (seed += 0x9e3779b97f4a7c15);
+		key = (key ^ (key >> 30)) * 0xbf58476d1ce4e5b9;
+		key = (key ^ (key >> 27)) * 0x94d049bb133111eb;
+		key ^= key >> 31;
 	}
 
+	// The graph has changed, so it gets a new serial number.
+	static std::atomic<std::uint64_t> nextSerial(1);
+	serial = nextSerial++;
+
+	// Check that we (still) have all colors.
+	unsigned numColors =
+		std::count_if(colorCounts.begin(), colorCounts.end(),
+			[](unsigned i) { return i > 0; });
+	if (numColors != colorCounts.size())
+		throw std::runtime_error("We have no nodes for some colors");
+}
+
+namespace {
+
+/// Scratch space for the nodes filled by a move.
+thread_local std::vector<bits::word_t> expansion;
+
+} // anonymous namespace
+
+State::State(const Graph &graph, MoveTrie &trie)
+	: words(2 * graph.getNumWords(), 0)
+	, moves(MoveTrie::initial())
+	, hash(graph.getNodeKey(graph.getRootIndex()))
+{
+	if (graph.getColorCounts().size() > 1u << MOVE_BITS)
+		throw std::runtime_error("Too many colors, rebuild with larger "
+		                         "MOVE_BITS");
+	moves = trie.append(moves, graph.getColor(graph.getRootIndex()));
+
+	// Check that the graph is reduced. We are going to assume that later.
+	assert(graph.isReduced());
+#ifndef NDEBUG
+	for (unsigned index = 0; index < graph.getNumNodes(); ++index)
+		for (unsigned neighbor : graph.getNeighbors(index))
+			assert(graph.getColor(index) != graph.getColor(neighbor));
+#endif
+
+	bits::set(filled(), graph.getRootIndex());
+	for (unsigned neighbor : graph.getNeighbors(graph.getRootIndex()))
+		bits::set(frontier(), neighbor);
 	valuation = computeValuation(graph);
-	return true;
 }
 
-unsigned State::computeValuation(const Graph &graph) const
+namespace {
+
+/**
+ * Breadth-first layers of the nodes that aren't filled, around the filled
+ * nodes of a state.
+ *
+ * Until the first color is eliminated, the valuation only does color-blind
+ * moves, which visit one layer after another. A move fills the nodes of its
+ * color in the frontier, which is layer 1. The nodes that can be reached from
+ * these on a shortest path get closer by one, all others stay where they are.
+ * So for every node, we keep the colors of the frontier nodes it can be
+ * reached from that way. The children of a state are generated one after
+ * another, so they can share the layers of their parent. From them we know
+ * where the first color is eliminated after a move, and only need to go on
+ * from there.
+ */
+struct Layers
 {
-	// Obtain a lower bound for the number of moves left. This is done by
-	// induction: If a move fills all remaining nodes of some color, it must be
-	// optimal, so we can just apply this move. Otherwise, we use a
-	// "color-blind" move as it combines the effects of all possible moves. This
-	// procedure will reduce the given state until it reaches the filled state.
+	// The graph and the hash of the filled nodes that we have the layers for,
+	// and the filled nodes themselves, in case of hash collisions.
+	std::uint64_t serial = 0, hash = 0;
+	std::vector<bits::word_t> filled;
+	// Can we use the layers? Not if some nodes can't be reached, or if there
+	// are too many colors for a mask. With few colors, a state has too few
+	// children to pay for the layers.
+	bool usable = false;
+	unsigned numLayers = 0;
 
-	// Bitfield to mark visited nodes (to avoid visiting a node more than once).
-	std::vector<bool> visited = filled;
+	// Distance of the nodes that aren't filled from the filled nodes.
+	std::vector<unsigned> distance;
+	// Colors of the frontier nodes from which the nodes can be reached on a
+	// shortest path, as bit masks. A move to one of them brings a node closer.
+	std::vector<std::uint64_t> origins;
+	// Nodes by layer: layer d is nodes[start[d]] up to nodes[start[d+1]]. The
+	// frontier is layer 1, layer 0 would be the filled nodes. After the last
+	// layer, there is an empty one.
+	std::vector<unsigned> nodes, start;
+	// Number of nodes of each color beyond layer d, for d up to numLayers,
+	// at beyond[d * numColors + color].
+	std::vector<unsigned> beyond;
+	// Last layer with nodes of each color, or 0 if there are none, and the
+	// colors of moves that bring all of these nodes closer.
+	std::vector<unsigned> lastLayer;
+	std::vector<std::uint64_t> lastOrigins;
+};
 
-	// Current (to be expanded) and next layer of nodes.
+/// Scratch space for the valuation, reused to avoid allocations.
+struct ValuationWorkspace
+{
+	std::vector<bits::word_t> visited;
 	std::vector<unsigned> current, next;
-	current.reserve(filled.size());
-	next.reserve(filled.size());
+	std::vector<unsigned> colorCounts, colorCountsOld;
+	Layers layers;
+};
 
-	// The remaining number of nodes for each color.
-	std::vector<unsigned> colorCounts = graph.getColorCounts();
+thread_local ValuationWorkspace workspace;
 
-	// We start with all the nodes that are already filled.
-	for (unsigned index = 0; index < filled.size(); ++index) {
-		if (filled[index]) {
-			current.push_back(index);
-			--colorCounts[graph[index].color];
-		}
-	}
+/**
+ * Count the moves needed to visit all nodes, proceeding from a layer.
+ *
+ * @param graph Graph to be based on.
+ * @param ws Workspace with the nodes of the layer in @c current, all nodes
+ *        visited so far in @c visited, and the number of nodes not visited for
+ *        each color in @c colorCounts.
+ * @param numExposedColors Number of colors that can be eliminated in the next
+ *        move.
+ * @return Lower bound for the number of moves.
+ */
+unsigned countMovesLeft(const Graph &graph, ValuationWorkspace &ws,
+                        unsigned numExposedColors)
+{
+	std::vector<unsigned> &current = ws.current, &next = ws.next;
+	std::vector<unsigned> &colorCounts = ws.colorCounts;
+	std::vector<unsigned> &colorCountsOld = ws.colorCountsOld;
+	bits::word_t *visited = ws.visited.data();
 
-	// Number of colors that can be eliminated in the next move.
-	unsigned numExposedColors = 0;
 	unsigned minMovesLeft = 0;
-
-	// This will serve as a backup copy of colorCounts in the loop.
-	std::vector<unsigned> colorCountsOld(colorCounts.size());
+	next.clear();
+	colorCountsOld.resize(colorCounts.size());
 
 	// Proceed layer by layer, expanding the current layer to obtain the next
 	// layer. The vector colorCounts keeps track of the colors of nodes that
@@ -214,13 +407,13 @@ unsigned State::computeValuation(const Graph &graph) const
 				colorCounts.begin(), colorCounts.end(), colorCountsOld.begin());
 			for (unsigned node : current) {
 				// If the color is to be eliminated, expand the node.
-				if (colorCountsOld[graph[node].color] == 0) {
+				if (colorCountsOld[graph.getColor(node)] == 0) {
 					// Expand node.
-					for (unsigned neighbor : graph[node].neighbors) {
-						if (!visited[neighbor]) {
+					for (unsigned neighbor : graph.getNeighbors(node)) {
+						if (!bits::test(visited, neighbor)) {
 							next.push_back(neighbor);
-							visited[neighbor] = true;
-							if (--colorCounts[graph[neighbor].color] == 0)
+							bits::set(visited, neighbor);
+							if (--colorCounts[graph.getColor(neighbor)] == 0)
 								++numExposedColors;
 						}
 					}
@@ -235,11 +428,11 @@ unsigned State::computeValuation(const Graph &graph) const
 			// Expand current layer of nodes.
 			for (unsigned node : current) {
 				// Expand node.
-				for (unsigned neighbor : graph[node].neighbors) {
-					if (!visited[neighbor]) {
+				for (unsigned neighbor : graph.getNeighbors(node)) {
+					if (!bits::test(visited, neighbor)) {
 						next.push_back(neighbor);
-						visited[neighbor] = true;
-						if (--colorCounts[graph[neighbor].color] == 0)
+						bits::set(visited, neighbor);
+						if (--colorCounts[graph.getColor(neighbor)] == 0)
 							++numExposedColors;
 					}
 				}
@@ -251,7 +444,363 @@ unsigned State::computeValuation(const Graph &graph) const
 		next.clear();
 	}
 
-	return moves.size() + minMovesLeft;
+	return minMovesLeft;
+}
+
+/**
+ * Compute the layers around the filled nodes of a state, unless we have them.
+ *
+ * @param ws Workspace, whose layers are replaced. Uses @c visited.
+ * @param filled Filled nodes of the state.
+ * @param frontier Frontier of the state.
+ * @param hash Hash of the filled nodes.
+ * @return True, if the layers can be used.
+ */
+bool prepareLayers(const Graph &graph, ValuationWorkspace &ws,
+                   const bits::word_t *filled, const bits::word_t *frontier,
+                   std::uint64_t hash)
+{
+	Layers &layers = ws.layers;
+	unsigned numNodes = graph.getNumNodes(), numWords = graph.getNumWords();
+	if (layers.serial == graph.getSerial() && layers.hash == hash &&
+	    layers.filled.size() == numWords &&
+	    std::equal(filled, filled + numWords, layers.filled.begin()))
+		return layers.usable;
+
+	color_t numColors = graph.getColorCounts().size();
+	layers.serial = graph.getSerial();
+	layers.hash = hash;
+	layers.filled.assign(filled, filled + numWords);
+	layers.usable = numColors >= 4 && numColors <= 64;
+	if (!layers.usable)
+		return false;
+
+	// Breadth-first search, starting with the frontier.
+	layers.distance.resize(numNodes);
+	layers.origins.resize(numNodes);
+	ws.visited.resize(numWords);
+	for (unsigned word = 0; word < numWords; ++word)
+		ws.visited[word] = filled[word] | frontier[word];
+	layers.nodes.clear();
+	bits::forEach(frontier, numWords,
+		[&](unsigned node) {
+			layers.nodes.push_back(node);
+			layers.distance[node] = 1;
+			layers.origins[node] = std::uint64_t(1) << graph.getColor(node);
+		});
+	layers.start.assign(2, 0);
+	for (unsigned distance = 2; layers.start.back() != layers.nodes.size();
+	     ++distance) {
+		unsigned begin = layers.start.back(), end = layers.nodes.size();
+		layers.start.push_back(end);
+		for (unsigned index = begin; index != end; ++index) {
+			unsigned node = layers.nodes[index];
+			for (unsigned neighbor : graph.getNeighbors(node)) {
+				if (!bits::test(ws.visited.data(), neighbor)) {
+					bits::set(ws.visited.data(), neighbor);
+					layers.distance[neighbor] = distance;
+					layers.origins[neighbor] = layers.origins[node];
+					layers.nodes.push_back(neighbor);
+				}
+				else if (layers.distance[neighbor] == distance &&
+				         !bits::test(filled, neighbor))
+					layers.origins[neighbor] |= layers.origins[node];
+			}
+		}
+	}
+	layers.numLayers = layers.start.size() - 2;
+	layers.start.push_back(layers.nodes.size());
+
+	// If some nodes can't be reached, the valuation never eliminates their
+	// colors. That doesn't happen for puzzles, so we don't bother.
+	layers.usable = bits::isFull(ws.visited.data(), numNodes);
+	if (!layers.usable)
+		return false;
+
+	// Count the nodes of each color from the last layer backwards.
+	layers.beyond.assign((layers.numLayers + 1) * numColors, 0);
+	layers.lastLayer.assign(numColors, 0);
+	layers.lastOrigins.resize(numColors);
+	for (unsigned layer = layers.numLayers; layer > 0; --layer) {
+		unsigned *row = layers.beyond.data() + (layer - 1) * numColors;
+		std::copy(row + numColors, row + 2 * numColors, row);
+		for (unsigned index = layers.start[layer];
+		     index != layers.start[layer + 1]; ++index) {
+			unsigned node = layers.nodes[index];
+			color_t color = graph.getColor(node);
+			++row[color];
+			if (layers.lastLayer[color] == 0) {
+				layers.lastLayer[color] = layer;
+				layers.lastOrigins[color] = ~std::uint64_t(0);
+			}
+			if (layers.lastLayer[color] == layer)
+				layers.lastOrigins[color] &= layers.origins[node];
+		}
+	}
+
+	return true;
+}
+
+/**
+ * Count the moves needed to fill all nodes after a move, from the layers of
+ * the state before the move, see @ref prepareLayers.
+ *
+ * The result is exactly what we get from scratch, starting with the filled
+ * nodes after the move: the color-blind moves up to the first layer that
+ * has the last nodes of some color, plus what @ref countMovesLeft counts from
+ * there.
+ *
+ * @param ws Workspace with usable layers.
+ * @param next Color of the move.
+ * @return Lower bound for the number of moves, counting the first
+ *         color-blind move that visits the frontier.
+ */
+unsigned countMovesLeftAfter(const Graph &graph, ValuationWorkspace &ws,
+                             color_t next)
+{
+	const Layers &layers = ws.layers;
+	color_t numColors = graph.getColorCounts().size();
+	std::uint64_t closer = std::uint64_t(1) << next;
+	assert(layers.usable);
+
+	// The last layer of a color moves up if all its nodes there get closer.
+	// The nodes of the move's color in layer 1 are filled then, so the color
+	// might disappear. The first of the last layers is where the first color
+	// can be eliminated.
+	unsigned firstLast = std::numeric_limits<unsigned>::max();
+	for (color_t color = 0; color < numColors; ++color) {
+		unsigned last = layers.lastLayer[color];
+		if (last != 0 && (layers.lastOrigins[color] & closer))
+			--last;
+		if (last != 0)
+			firstLast = std::min(firstLast, last);
+	}
+
+	// If all nodes are filled, there is only the color-blind move.
+	if (firstLast == std::numeric_limits<unsigned>::max())
+		return 1;
+
+	// Go on from that layer, like countMovesLeft would get there: it has just
+	// been visited, the colors whose last nodes are in it are exposed, and
+	// the nodes beyond it haven't been visited yet.
+	unsigned numExposedColors = 0;
+	for (color_t color = 0; color < numColors; ++color) {
+		unsigned last = layers.lastLayer[color];
+		if (last == firstLast + 1 && (layers.lastOrigins[color] & closer))
+			++numExposedColors;
+		else if (last == firstLast && !(layers.lastOrigins[color] & closer))
+			++numExposedColors;
+	}
+
+	const unsigned *beyond = layers.beyond.data() + firstLast * numColors;
+	ws.colorCounts.assign(beyond, beyond + numColors);
+	ws.current.clear();
+	ws.visited.assign(graph.getNumWords(), ~bits::word_t(0));
+	for (unsigned index = layers.start[firstLast];
+	     index != layers.start[firstLast + 1]; ++index) {
+		unsigned node = layers.nodes[index];
+		if (!(layers.origins[node] & closer))
+			ws.current.push_back(node);
+	}
+	for (unsigned index = layers.start[firstLast + 1];
+	     index != layers.start[firstLast + 2]; ++index) {
+		unsigned node = layers.nodes[index];
+		if (layers.origins[node] & closer) {
+			ws.current.push_back(node);
+			--ws.colorCounts[graph.getColor(node)];
+		}
+		else
+			bits::reset(ws.visited.data(), node);
+	}
+	for (unsigned index = layers.start[firstLast + 2];
+	     index != layers.nodes.size(); ++index)
+		bits::reset(ws.visited.data(), layers.nodes[index]);
+
+	return firstLast + countMovesLeft(graph, ws, numExposedColors);
+}
+
+} // anonymous namespace
+
+bool State::move(const Graph &graph, MoveTrie &trie, color_t next,
+                 bool canonical)
+{
+	assert(next != moves.back());
+
+	color_t last = moves.back();
+	moves = trie.append(moves, next);
+
+	// The nodes of the next color adjacent to filled nodes are filled. We
+	// only look at the nodes of that color, through its mask.
+	unsigned numWords = graph.getNumWords();
+	expansion.resize(numWords);
+	if (!bits::intersect(
+			expansion.data(), frontier(), graph.getColorMask(next), numWords))
+		return false;
+
+	if (canonical && next < last) {
+		// Does the move change anything that couldn't have happened before?
+		bool additionalExpansion = false;
+		bits::forEach(expansion.data(), numWords,
+			[&](unsigned node)
+			{
+				// Was any of the neighbors filled before the last move?
+				bool prev = false;
+				for (unsigned neighbor : graph.getNeighbors(node))
+					if (bits::test(filled(), neighbor)
+							&& graph.getColor(neighbor) != last)
+						prev = true;
+				if (!prev)
+					additionalExpansion = true;
+			}
+		);
+
+		if (!additionalExpansion)
+			return false;
+	}
+
+	// The valuation starts from the layers around the nodes filled so far,
+	// which all children of this state share.
+	ValuationWorkspace &ws = workspace;
+	bool useLayers = prepareLayers(graph, ws, filled(), frontier(), hash);
+
+	// Fill the nodes and extend the frontier by their unfilled neighbors.
+	// These can't have the next color, so the expansion stays unaffected.
+	bits::transfer(filled(), frontier(), expansion.data(), numWords);
+	bits::forEach(expansion.data(), numWords,
+		[&](unsigned node)
+		{
+			hash ^= graph.getNodeKey(node);
+			for (unsigned neighbor : graph.getNeighbors(node))
+				if (!bits::test(filled(), neighbor))
+					bits::set(frontier(), neighbor);
+		}
+	);
+
+	if (useLayers) {
+		valuation = moves.size() +
+			countMovesLeftAfter(graph, ws, next);
+		assert(valuation == computeValuationFromScratch(graph));
+	}
+	else
+		valuation = computeValuation(graph);
+	return true;
+}
+
+unsigned State::computeValuation(const Graph &graph) const
+{
+	// Obtain a lower bound for the number of moves left. This is done by
+	// induction: If a move fills all remaining nodes of some color, it must be
+	// optimal, so we can just apply this move. Otherwise, we use a
+	// "color-blind" move as it combines the effects of all possible moves. This
+	// procedure will reduce the given state until it reaches the filled state.
+	//
+	// Starting with the filled nodes, no color can be eliminated yet, so the
+	// first move is always color-blind, and it visits exactly the frontier.
+	// Since we maintain the frontier in move(), we can start from there. The
+	// layers after that depend on the whole filled region, so they are
+	// computed anew for every state.
+	ValuationWorkspace &ws = workspace;
+	unsigned numWords = graph.getNumWords();
+
+	// Visited nodes are the filled nodes and the frontier.
+	ws.visited.resize(numWords);
+	for (unsigned word = 0; word < numWords; ++word)
+		ws.visited[word] = filled()[word] | frontier()[word];
+
+	// The remaining number of nodes for each color. If the frontier has the
+	// remaining nodes of a color, we can eliminate it in the next move.
+	unsigned numExposedColors = 0;
+	ws.colorCounts = graph.getColorCounts();
+	for (color_t color = 0; color < ws.colorCounts.size(); ++color) {
+		const bits::word_t *mask = graph.getColorMask(color);
+		unsigned inFrontier =
+			bits::countIntersection(frontier(), mask, numWords);
+		ws.colorCounts[color] -= inFrontier +
+			bits::countIntersection(filled(), mask, numWords);
+		if (inFrontier > 0 && ws.colorCounts[color] == 0)
+			++numExposedColors;
+	}
+
+	ws.current.clear();
+	bits::forEach(frontier(), numWords,
+		[&ws](unsigned index) { ws.current.push_back(index); });
+
+	unsigned result =
+		moves.size() + 1 + countMovesLeft(graph, ws, numExposedColors);
+	assert(result == computeValuationFromScratch(graph));
+	return result;
+}
+
+unsigned State::computeValuationFromScratch(const Graph &graph) const
+{
+	// Start with the filled nodes, without using the frontier.
+	ValuationWorkspace &ws = workspace;
+	unsigned numWords = graph.getNumWords();
+	ws.visited.assign(filled(), filled() + numWords);
+
+	ws.colorCounts = graph.getColorCounts();
+	for (color_t color = 0; color < ws.colorCounts.size(); ++color)
+		ws.colorCounts[color] -= bits::countIntersection(
+			filled(), graph.getColorMask(color), numWords);
+
+	ws.current.clear();
+	bits::forEach(filled(), numWords,
+		[&ws](unsigned index) { ws.current.push_back(index); });
+
+	return moves.size() + countMovesLeft(graph, ws, 0);
+}
+
+namespace {
+
+/// Number of words for a move sequence in a record.
+constexpr unsigned SEQUENCE_WORDS =
+	(sizeof(State::MoveTrie::Sequence) + sizeof(bits::word_t) - 1)
+	/ sizeof(bits::word_t);
+
+} // anonymous namespace
+
+unsigned State::getRecordSize(const Graph &graph)
+{
+	return SEQUENCE_WORDS + 1 + graph.getNumWords();
+}
+
+void State::save(bits::word_t *record) const
+{
+	static_assert(std::is_trivially_copyable<MoveTrie::Sequence>::value,
+	              "Sequences must be trivially copyable");
+	std::memcpy(record, &moves, sizeof moves);
+	record[SEQUENCE_WORDS] = valuation;
+	std::copy(filled(), filled() + words.size() / 2,
+	          record + SEQUENCE_WORDS + 1);
+}
+
+void State::load(const Graph &graph, const bits::word_t *record)
+{
+	unsigned numWords = graph.getNumWords();
+	std::memcpy(static_cast<void*>(&moves), record, sizeof moves);
+	valuation = record[SEQUENCE_WORDS];
+	words.assign(2 * numWords, 0);
+	std::copy(record + SEQUENCE_WORDS + 1, record + SEQUENCE_WORDS + 1 + numWords,
+	          filled());
+
+	// Restore hash and frontier.
+	hash = 0;
+	bits::forEach(filled(), numWords,
+		[&](unsigned node)
+		{
+			hash ^= graph.getNodeKey(node);
+			for (unsigned neighbor : graph.getNeighbors(node))
+				if (!bits::test(filled(), neighbor))
+					bits::set(frontier(), neighbor);
+		}
+	);
+}
+
+State::MoveTrie::Sequence State::loadMoves(const bits::word_t *record)
+{
+	MoveTrie::Sequence moves = MoveTrie::initial();
+	std::memcpy(static_cast<void*>(&moves), record, sizeof moves);
+	return moves;
 }
 
 std::vector<color_t> State::materializeMoves() const
@@ -261,56 +810,582 @@ std::vector<color_t> State::materializeMoves() const
 	return result;
 }
 
-bool State::done() const
+bool State::done(const Graph &graph) const
 {
-	return std::all_of(filled.begin(), filled.end(), [](bool x) { return x; });
+	return bits::isFull(filled(), graph.getNumNodes());
 }
 
 namespace {
 
-struct StateCompare
+/// Width of the beam if the greedy search is far from optimal.
+constexpr unsigned WIDE_BEAM = 4;
+
+/// Number of moves more than the lower bound from which we try a wide beam.
+constexpr unsigned LOOSE_GAP = 8;
+
+/// Beam search, see @ref computeGreedySequence.
+std::vector<color_t> beamSearch(const Graph &graph, unsigned beamWidth)
 {
-	bool operator()(const State &a, const State &b) const
-	{
-		if (a.getValuation() != b.getValuation())
-			return a.getValuation() > b.getValuation();
-		return a.getNumMoves() < b.getNumMoves();
+	State::MoveTrie trie;
+	std::vector<State> beam{State(graph, trie)}, children;
+
+	// All states in the beam have the same number of moves, so the first done
+	// state is the best we can find.
+	while (!beam.empty()) {
+		for (const State &state : beam) {
+			if (state.done(graph)) {
+				assert(state.getValuation() == state.getNumMoves() + 1);
+				return state.materializeMoves();
+			}
+		}
+
+		// We don't try all orders of moves here, so we allow all of them.
+		// Otherwise the beam might run into dead ends.
+		children.clear();
+		color_t numColors = graph.getColorCounts().size();
+		for (const State &state : beam) {
+			for (color_t next = 0; next < numColors; ++next) {
+				if (next == state.getLastColor())
+					continue;
+
+				children.push_back(state);
+				if (!children.back().move(graph, trie, next, false))
+					children.pop_back();
+			}
+		}
+
+		// Keep the best children. States with the same filled region have the
+		// same valuation, so sorting by hash as well brings duplicates
+		// together.
+		std::sort(children.begin(), children.end(),
+			[](const State &a, const State &b) {
+				return a.getValuation() != b.getValuation()
+					? a.getValuation() < b.getValuation()
+					: a.getHash() < b.getHash();
+			});
+		children.erase(std::unique(children.begin(), children.end(),
+			[](const State &a, const State &b)
+				{ return a.getHash() == b.getHash(); }),
+			children.end());
+		if (children.size() > beamWidth)
+			children.erase(children.begin() + beamWidth, children.end());
+		beam.swap(children);
 	}
-};
+
+	// Without any moves left, the graph can't be connected.
+	return {};
+}
 
 } // anonymous namespace
 
-std::vector<color_t> computeBestSequence(const Graph &graph)
+std::vector<color_t> computeGreedySequence(const Graph &graph,
+                                           unsigned beamWidth)
+{
+	if (beamWidth != 0)
+		return beamSearch(graph, beamWidth);
+
+	// The final state of a sequence has one more than its number of moves as
+	// valuation. If that's as low as that of the initial state, it's optimal.
+	// If it's much higher, the search will take long, and a tighter bound is
+	// worth a wider beam. Otherwise that would take longer than it saves.
+	std::vector<color_t> greedy = beamSearch(graph, 1);
+	State::MoveTrie trie;
+	unsigned lowerBound = State(graph, trie).getValuation();
+	if (greedy.empty() || greedy.size() + 1 < lowerBound + LOOSE_GAP)
+		return greedy;
+	return beamSearch(graph, WIDE_BEAM);
+}
+
+namespace {
+
+/**
+ * Iterative deepening A^* search.
+ * @param graph Graph to solve.
+ * @param greedy Best solution known so far, for an upper bound, or empty if
+ *        there is none.
+ * @param bound Lower bound for the valuation of better solutions.
+ * @return Best sequence.
+ */
+std::vector<color_t> iterativeDeepening(
+	const Graph &graph, const std::vector<color_t> &greedy, unsigned bound);
+
+/// Number of expansions after which searches update their memory usage.
+constexpr unsigned MEMORY_CHECK_INTERVAL = 1024;
+
+/// Number of live trie blocks below which we don't collect garbage.
+constexpr std::size_t MIN_COLLECT_BLOCKS = 1 << 16;
+
+/**
+ * Reclaim the trie storage of states that are no longer in the queue.
+ *
+ * This takes time linear in the size of the queue, so we only do it when the
+ * live blocks have doubled since the last time.
+ *
+ * @param threshold Number of live blocks at which to collect, updated.
+ */
+void collectGarbage(State::MoveTrie &trie,
+                    const BucketQueue<StateArena::Handle> &queue,
+                    const StateArena &arena, std::size_t &threshold)
+{
+	if (trie.getStats().liveBlocks < threshold)
+		return;
+
+	queue.forEach([&trie, &arena](StateArena::Handle handle)
+		{ trie.markLive(arena.getMoves(handle)); });
+	trie.sweep();
+	threshold = std::max(MIN_COLLECT_BLOCKS, 2 * trie.getStats().liveBlocks);
+}
+
+/**
+ * Generate the children of a state for A^*.
+ *
+ * Tries all colors but the last one used, and skips moves that make no sense
+ * or can't lead to a solution with a smaller valuation than @p bound.
+ *
+ * @param child State to overwrite with every child.
+ * @param visit Function to call with every child.
+ */
+template<typename Visit>
+void expand(const Graph &graph, State::MoveTrie &trie, const State &state,
+            State &child, unsigned bound, Visit visit)
+{
+	color_t numColors = graph.getColorCounts().size();
+	for (color_t next = 0; next < numColors; ++next) {
+		if (next == state.getLastColor())
+			continue;
+
+		child = state;
+		if (!child.move(graph, trie, next))
+			continue;
+		if (child.getValuation() >= bound)
+			continue;
+
+		visit(child);
+	}
+}
+
+/**
+ * A^* search within a memory budget.
+ * @param graph Graph to solve.
+ * @param budget Memory budget for the search.
+ * @param helpers Pool of idle threads to continue with, or nullptr.
+ * @param bound Only look for solutions with a smaller valuation.
+ * @param[out] solution Best sequence, or empty if there is none.
+ * @param[out] lowerBound Smallest valuation of states that haven't been
+ *             expanded, if the budget runs out.
+ * @return True, if the search was completed within the budget.
+ */
+bool searchWithinBudget(const Graph &graph, MemoryBudget &budget,
+                        HelperPool *helpers, unsigned bound,
+                        std::vector<color_t> &solution, unsigned &lowerBound)
 {
-	std::vector<State> queue;
-	Trie<color_t> trie;
+	MemoryBudget::Account account(budget);
+
+	// States with the smallest valuation come first. If that's not unique, we
+	// prefer the state with more moves, since it's likely closer to the goal.
+	// The queue has handles to the states, which are stored in the arena.
+	BucketQueue<StateArena::Handle> queue;
+	StateArena arena(graph);
+	State::MoveTrie trie;
+	TranspositionTable table;
+
+	// We load states into these instead of creating new ones.
+	State state(graph, trie);
+	State nextState = state;
+	if (state.getValuation() >= bound)
+		return true;
 
-	queue.emplace_back(graph, trie);
+	table.insert(state.getHash(), state.getNumMoves());
+	queue.push(state.getValuation(), state.getNumMoves(), arena.store(state));
 
+	unsigned expansions = 0;
+	std::size_t collectThreshold = MIN_COLLECT_BLOCKS;
 	while (!queue.empty()) {
-		std::pop_heap(queue.begin(), queue.end(), StateCompare{});
-		State state = std::move(queue.back());
-		queue.pop_back();
+		if (++expansions % MEMORY_CHECK_INTERVAL == 0) {
+			// Only states in the queue still need their moves.
+			collectGarbage(trie, queue, arena, collectThreshold);
+			if (!account.update(queue.memoryUsage() + arena.memoryUsage() +
+			                    trie.memoryUsage() + table.memoryUsage())) {
+				lowerBound = queue.lowestKey();
+				return false;
+			}
+
+			// Let idle threads help. The trie has to stay, since the moves
+			// of the states continue in it, but it doesn't grow anymore.
+			if (helpers && helpers->numIdle() != 0)
+				return continueParallel(graph, std::move(queue),
+					std::move(arena), std::move(table), bound, *helpers,
+					account, trie.memoryUsage(), solution, lowerBound);
+		}
+
+		StateArena::Handle handle = queue.pop();
+		arena.load(handle, state);
+		arena.release(handle);
+
+		// Skip the state if its region has since been reached in fewer moves.
+		if (table.lookup(state.getHash()) < state.getNumMoves())
+			continue;
+
+		if (state.done(graph)) {
+			solution = state.materializeMoves();
+			return true;
+		}
+
+		expand(graph, trie, state, nextState, bound,
+			[&](const State &child) {
+				// Drop duplicates: if we have reached the same region with at
+				// most as many moves, this state can't lead to anything better.
+				if (table.insert(child.getHash(), child.getNumMoves()))
+					queue.push(child.getValuation(), child.getNumMoves(),
+						arena.store(child));
+			});
+	}
+
+	return true;
+}
+
+/// A^* search, see @ref computeBestSequence, with optional helpers.
+std::vector<color_t> bestSequence(const Graph &graph, MemoryBudget &budget,
+                                  HelperPool *helpers)
+{
+	// A quick solution gives us an upper bound: the valuation of its final
+	// state, which has one more than its number of moves. States that can't
+	// improve on it aren't stored, and if we find nothing better, it's optimal.
+	std::vector<color_t> greedy = computeGreedySequence(graph);
+	unsigned bound = greedy.empty()
+		? std::numeric_limits<unsigned>::max() : greedy.size() + 1;
+
+	// If we run out of memory, go on with iterative deepening. It needs almost
+	// no memory, and can start with the lower bound that A^* has reached. A
+	// parallel search might have found something better than the quick
+	// solution already.
+	std::vector<color_t> solution;
+	unsigned lowerBound;
+	if (!searchWithinBudget(graph, budget, helpers, bound, solution,
+	                        lowerBound))
+		return iterativeDeepening(graph, solution.empty() ? greedy : solution,
+		                          lowerBound);
+	if (!solution.empty())
+		return solution;
+
+	// Nothing is better than the quick solution. If we don't have one either,
+	// the graph is probably not connected.
+	if (greedy.empty())
+		throw std::runtime_error("Graph seems to be not connected");
+	return greedy;
+}
+
+} // anonymous namespace
+
+std::vector<color_t> computeBestSequence(const Graph &graph)
+{
+	MemoryBudget unlimited;
+	return computeBestSequence(graph, unlimited);
+}
+
+std::vector<color_t> computeBestSequence(const Graph &graph,
+                                         MemoryBudget &budget)
+{
+	return bestSequence(graph, budget, nullptr);
+}
+
+std::vector<color_t> computeBestSequence(const Graph &graph,
+                                         MemoryBudget &budget,
+                                         HelperPool &helpers)
+{
+	return bestSequence(graph, budget, &helpers);
+}
 
-		if (state.done())
+std::vector<color_t> computeBestSequenceExternal(const Graph &graph,
+                                                 const std::string &directory,
+                                                 std::size_t bufferSize)
+{
+	std::vector<color_t> greedy = computeGreedySequence(graph);
+	unsigned bound = greedy.empty()
+		? std::numeric_limits<unsigned>::max() : greedy.size() + 1;
+
+	// States come in the same order as in A^*, so the first done state is the
+	// best. Duplicates are dropped when a bucket is taken, so we don't need a
+	// transposition table. Only the buffers and the move trie stay in memory.
+	ExternalQueue queue(graph, directory, bufferSize);
+	State::MoveTrie trie;
+	State state(graph, trie);
+	State nextState = state;
+	if (state.getValuation() < bound)
+		queue.push(state.getValuation(), state.getNumMoves(), state);
+
+	while (queue.pop(state)) {
+		if (state.done(graph))
 			return state.materializeMoves();
 
+		expand(graph, trie, state, nextState, bound,
+			[&queue](const State &child) {
+				queue.push(child.getValuation(), child.getNumMoves(), child);
+			});
+	}
+
+	if (greedy.empty())
+		throw std::runtime_error("Graph seems to be not connected");
+	return greedy;
+}
+
+BoundedSequence computeBoundedSequence(const Graph &graph, double weight,
+                                       double improveFor)
+{
+	MemoryBudget unlimited;
+	return computeBoundedSequence(graph, weight, improveFor, unlimited);
+}
+
+BoundedSequence computeBoundedSequence(const Graph &graph, double weight,
+                                       double improveFor, MemoryBudget &budget)
+{
+	// The priority g + w h in fixed point, with the weight rounded down to a
+	// multiple of 1/SCALE, so that we never exceed it. Here g is the number
+	// of moves so far and h the lower bound for the moves left, both without
+	// the initial color. The valuation is g + h + 2.
+	const unsigned SCALE = 8;
+	const unsigned scaledWeight = std::floor(std::max(weight, 1.0) * SCALE);
+	auto priority = [&](const State &state) {
+		unsigned g = state.getNumMoves() - 1;
+		unsigned h = state.getValuation() - 2 - g;
+		return g * SCALE + h * scaledWeight;
+	};
+
+	// Like in computeBestSequence, the incumbent sequence gives an upper
+	// bound. We keep it as the valuation of its final state, which is the
+	// number of moves plus two: one for the initial color, one for being done.
+	const unsigned NO_BOUND = std::numeric_limits<unsigned>::max();
+	BoundedSequence best{computeGreedySequence(graph), 0};
+	unsigned bound = best.moves.empty() ? NO_BOUND : best.moves.size() + 1;
+
+	// If we run out of memory, we stop with what we have.
+	MemoryBudget::Account account(budget);
+	BucketQueue<StateArena::Handle> queue;
+	StateArena arena(graph);
+	State::MoveTrie trie;
+	TranspositionTable table;
+
+	// Number of states in the queue by valuation. The smallest valuation of a
+	// state that might still lead to a better sequence is a lower bound.
+	std::vector<std::size_t> numByValuation;
+	unsigned minValuation = 0;      // No smaller valuation has states.
+	auto push = [&](State &state) {
+		unsigned valuation = state.getValuation();
+		if (valuation >= numByValuation.size())
+			numByValuation.resize(valuation + 1);
+		++numByValuation[valuation];
+		minValuation = std::min(minValuation, valuation);
+		queue.push(priority(state), state.getNumMoves(), arena.store(state));
+	};
+	auto lowerBound = [&]() {
+		while (minValuation < numByValuation.size() &&
+		       numByValuation[minValuation] == 0)
+			++minValuation;
+		return std::min(minValuation, bound);
+	};
+
+	State state(graph, trie);
+	State nextState = state;
+	table.insert(state.getHash(), state.getNumMoves());
+	push(state);
+
+	// Once we have a good enough sequence, we only go on until the deadline.
+	// That's the first sequence we find, or the incumbent if the lower bound
+	// shows that it's within the weight. Both have the valuation of a done
+	// state, which is the number of moves plus two.
+	bool found = false;
+	std::chrono::steady_clock::time_point deadline;
+	unsigned expansions = 0;
+	std::size_t collectThreshold = MIN_COLLECT_BLOCKS;
+
+	while (!queue.empty() && lowerBound() < bound) {
+		if (!found && bound != NO_BOUND &&
+		    (bound - 2) * SCALE <= (lowerBound() - 2) * scaledWeight)
+			found = true;
+
+		// Having found a sequence, we start the clock.
+		if (found && deadline == std::chrono::steady_clock::time_point()) {
+			if (improveFor <= 0)
+				break;
+			deadline = std::chrono::steady_clock::now() +
+				std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+					std::chrono::duration<double>(improveFor));
+		}
+		else if (found && expansions % 1024 == 0 &&
+		         std::chrono::steady_clock::now() >= deadline)
+			break;
+
+		if (++expansions % MEMORY_CHECK_INTERVAL == 0) {
+			collectGarbage(trie, queue, arena, collectThreshold);
+			if (!account.update(queue.memoryUsage() + arena.memoryUsage() +
+			                    trie.memoryUsage() + table.memoryUsage() +
+			                    numByValuation.size() * sizeof(std::size_t)))
+				break;
+		}
+
+		StateArena::Handle handle = queue.pop();
+		arena.load(handle, state);
+		arena.release(handle);
+		--numByValuation[state.getValuation()];
+
+		// Skip the state if it can't improve on the incumbent, or if its
+		// region has since been reached in fewer moves.
+		if (state.getValuation() >= bound ||
+		    table.lookup(state.getHash()) < state.getNumMoves())
+			continue;
+
+		if (state.done(graph)) {
+			best.moves = state.materializeMoves();
+			bound = state.getValuation();
+			found = true;
+			continue;
+		}
+
 		// Try all colors but the last one used.
 		color_t numColors = graph.getColorCounts().size();
 		for (color_t next = 0; next < numColors; ++next) {
 			if (next == state.getLastColor())
 				continue;
 
-			State nextState = state;
+			nextState = state;
 			if (!nextState.move(graph, trie, next))
 				continue;
+			if (nextState.getValuation() >= bound)
+				continue;
+			if (!table.insert(nextState.getHash(), nextState.getNumMoves()))
+				continue;
 
-			queue.push_back(std::move(nextState));
-			std::push_heap(queue.begin(), queue.end(), StateCompare{});
+			push(nextState);
 		}
 	}
 
-	// If we didn't find any way to flood fill the entire graph, then it's
-	// probably not connected.
-	throw std::runtime_error("Graph seems to be not connected");
+	if (best.moves.empty())
+		throw std::runtime_error("Graph seems to be not connected");
+	best.lowerBound = lowerBound() - 2;
+	return best;
+}
+
+namespace {
+
+/**
+ * Depth-first search with a bound on the valuation.
+ *
+ * We keep the children of the states on the current path, so memory is linear
+ * in the depth. The trie is used as a stack: when we leave a state, we rewind
+ * it to where it was when we came.
+ */
+class DepthFirstSearch
+{
+public:
+	DepthFirstSearch(const Graph &graph, State::MoveTrie &trie)
+		: graph(graph), trie(trie) {}
+
+	/**
+	 * Search for a solution within the bound.
+	 * @param state Initial state.
+	 * @param bound Largest valuation of states to be expanded.
+	 * @return True, if a solution was found. Then it's in @ref solution,
+	 *         otherwise @ref nextBound has the smallest valuation that
+	 *         exceeded @p bound.
+	 */
+	bool run(const State &state, unsigned bound)
+	{
+		this->bound = bound;
+		nextBound = std::numeric_limits<unsigned>::max();
+		return expand(state, 0);
+	}
+
+	std::vector<color_t> solution;
+	unsigned nextBound;
+
+private:
+	bool expand(const State &state, unsigned depth);
+
+	const Graph &graph;
+	State::MoveTrie &trie;
+	unsigned bound;
+
+	// Children of the states on the current path, by depth. We overwrite them
+	// instead of creating new ones, so that their memory is reused.
+	std::deque<std::vector<State>> children;
+};
+
+bool DepthFirstSearch::expand(const State &state, unsigned depth)
+{
+	if (state.done(graph)) {
+		solution = state.materializeMoves();
+		return true;
+	}
+
+	if (depth == children.size())
+		children.emplace_back();
+	std::vector<State> &level = children[depth];
+	std::size_t mark = trie.mark();
+
+	// Generate the children within the bound.
+	unsigned numChildren = 0;
+	color_t numColors = graph.getColorCounts().size();
+	for (color_t next = 0; next < numColors; ++next) {
+		if (next == state.getLastColor())
+			continue;
+
+		if (numChildren == level.size())
+			level.push_back(state);
+		else
+			level[numChildren] = state;
+
+		State &child = level[numChildren];
+		if (!child.move(graph, trie, next))
+			continue;
+
+		if (child.getValuation() > bound)
+			nextBound = std::min(nextBound, child.getValuation());
+		else
+			++numChildren;
+	}
+
+	// Try the most promising children first.
+	std::sort(level.begin(), level.begin() + numChildren,
+		[](const State &a, const State &b)
+			{ return a.getValuation() < b.getValuation(); });
+
+	for (unsigned index = 0; index < numChildren; ++index)
+		if (expand(level[index], depth + 1))
+			return true;
+
+	trie.rewind(mark);
+	return false;
+}
+
+} // anonymous namespace
+
+namespace {
+
+std::vector<color_t> iterativeDeepening(
+	const Graph &graph, const std::vector<color_t> &greedy, unsigned bound)
+{
+	State::MoveTrie trie;
+	State initial(graph, trie);
+	DepthFirstSearch search(graph, trie);
+
+	// With a quick solution, we can stop once the bound can't improve on it.
+	bound = std::max(bound, initial.getValuation());
+	while (greedy.empty() || bound <= greedy.size()) {
+		if (search.run(initial, bound))
+			return search.solution;
+
+		// If there is nothing left to expand, the graph can't be connected.
+		if (search.nextBound == std::numeric_limits<unsigned>::max())
+			throw std::runtime_error("Graph seems to be not connected");
+		bound = search.nextBound;
+	}
+
+	return greedy;
+}
+
+} // anonymous namespace
+
+std::vector<color_t> computeBestSequenceIDA(const Graph &graph)
+{
+	return iterativeDeepening(graph, computeGreedySequence(graph), 0);
 }
@@ -1,20 +1,52 @@
 #include <algorithm>
+#include <functional>
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <map>
-#include <queue>
 #include <string>
 #include <utility>
 #include <vector>
 
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <condition_variable>
+#include <cstdint>
 #include <mutex>
 #include <thread>
 
+#include <fcntl.h>
+#include <getopt.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/mempolicy.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#endif
+
+#include "boundedqueue.hpp"
 #include "floodit.hpp"
 
 namespace {
 
+/// Function computing a sequence for a reduced graph, with a lower bound.
+using Solver = std::function<BoundedSequence(const Graph&)>;
+
+/// Solver for an algorithm that always computes the best sequence.
+Solver exactSolver(std::function<std::vector<color_t>(const Graph&)> algorithm)
+{
+	return [algorithm](const Graph &graph) {
+		BoundedSequence result{algorithm(graph), 0};
+		result.lowerBound = result.moves.size() - 1;
+		return result;
+	};
+}
+
 class ColorArray
 {
 public:
@@ -22,6 +54,7 @@ public:
 	           unsigned originRow, unsigned originColumn);
 	void setColor(unsigned row, unsigned column, std::string&& color);
 
+	std::vector<color_t> getCells();
 	Graph createGraph();
 	std::vector<std::string> getColors() const;
 
@@ -48,27 +81,24 @@ void ColorArray::setColor(unsigned int row, unsigned int column,
 	array[nodeIndex(row, column)] = it.first;
 }
 
-Graph ColorArray::createGraph()
+std::vector<color_t> ColorArray::getCells()
 {
 	// Assign numbers to colors.
 	color_t color = 0;
 	for (auto &pair : colorMap)
 		pair.second = color++;
 
-	Graph graph(rows * columns);
-	graph.setRootIndex(originIndex);
-	for (unsigned i = 0; i < rows; ++i) {
-		for (unsigned j = 0; j < columns; ++j) {
-			if (i > 0)
-				graph.addEdge(nodeIndex(i-1, j), nodeIndex(i, j));
-			if (j > 0)
-				graph.addEdge(nodeIndex(i, j-1), nodeIndex(i, j));
+	std::vector<color_t> cells(array.size());
+	std::transform(array.begin(), array.end(), cells.begin(),
+		[](decltype(colorMap)::const_iterator it) { return it->second; }
+	);
 
-			graph.setColor(nodeIndex(i, j), array[nodeIndex(i, j)]->second);
-		}
-	}
+	return cells;
+}
 
-	return graph;
+Graph ColorArray::createGraph()
+{
+	return Graph::fromGrid(rows, columns, getCells(), originIndex);
 }
 
 std::vector<std::string> ColorArray::getColors() const
@@ -81,119 +111,672 @@ std::vector<std::string> ColorArray::getColors() const
 	return colors;
 }
 
+/**
+ * Read-only view of a whole file.
+ *
+ * Regular files are mapped into memory. Others, like pipes, are read instead.
+ */
+class MappedFile
+{
+public:
+	explicit MappedFile(const char *path);
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool fail() const { return failed; }
+	const char* begin() const { return data; }
+	const char* end() const { return data + size; }
+
+private:
+	const char *data = nullptr;
+	std::size_t size = 0;
+	void *mapping = nullptr;
+	std::vector<char> buffer;
+	bool failed = false;
+};
+
+MappedFile::MappedFile(const char *path)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd == -1) {
+		failed = true;
+		return;
+	}
+
+	struct stat status;
+	if (fstat(fd, &status) == 0 && S_ISREG(status.st_mode)) {
+		size = status.st_size;
+		if (size > 0) {
+			mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (mapping == MAP_FAILED) {
+				mapping = nullptr;
+				failed = true;
+			}
+			else {
+				madvise(mapping, size, MADV_SEQUENTIAL);
+				data = static_cast<const char*>(mapping);
+			}
+		}
+	}
+	else {
+		char chunk[1 << 16];
+		ssize_t count;
+		while ((count = read(fd, chunk, sizeof chunk)) > 0)
+			buffer.insert(buffer.end(), chunk, chunk + count);
+		failed = count == -1;
+		data = buffer.data();
+		size = buffer.size();
+	}
+
+	close(fd);
+}
+
+MappedFile::~MappedFile()
+{
+	if (mapping)
+		munmap(mapping, size);
+}
+
+/**
+ * Limit on the puzzles that have been read, but whose results haven't been
+ * written yet.
+ *
+ * Results have to be written in the order of the input, so a hard puzzle holds
+ * back all that come after it. Without a limit, the others would pile up.
+ */
+class ReorderWindow
+{
+public:
+	/// Time the reader spent waiting.
+	struct WaitStats
+	{
+		std::uint64_t waits;
+		double seconds;
+	};
+
+	ReorderWindow(std::size_t maxPuzzles, std::size_t maxBytes)
+		: maxPuzzles(maxPuzzles), maxBytes(maxBytes) {}
+
+	/// Wait until a puzzle of the given size fits, then add it.
+	void enter(std::size_t bytes)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		if (!fits(bytes)) {
+			auto start = std::chrono::steady_clock::now();
+			left.wait(lock, [this, bytes]() { return fits(bytes); });
+			++stats.waits;
+			stats.seconds += std::chrono::duration<double>(
+				std::chrono::steady_clock::now() - start).count();
+		}
+		++numPuzzles;
+		usedBytes += bytes;
+	}
+
+	/// Remove a puzzle of the given size, whose result has been written.
+	void leave(std::size_t bytes)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		--numPuzzles;
+		usedBytes -= bytes;
+		left.notify_one();
+	}
+
+	WaitStats getStats() const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return stats;
+	}
+
+private:
+	/// A single puzzle always fits, no matter how large.
+	bool fits(std::size_t bytes) const
+	{
+		return numPuzzles == 0 ||
+		       (numPuzzles < maxPuzzles && usedBytes + bytes <= maxBytes);
+	}
+
+private:
+	const std::size_t maxPuzzles, maxBytes;
+
+	mutable std::mutex mutex;
+	std::condition_variable left;
+	std::size_t numPuzzles = 0, usedBytes = 0;
+	WaitStats stats{0, 0};
+};
+
+/**
+ * Output of a single thread, written in batches.
+ *
+ * Every batch is written with a single system call, and consists of whole
+ * lines. Batches are no larger than what pipes write atomically, so lines of
+ * different threads don't get mixed up.
+ */
+class OutputBuffer
+{
+public:
+	explicit OutputBuffer(int fd) : fd(fd) {}
+	~OutputBuffer() { flush(); }
+
+	OutputBuffer(const OutputBuffer&) = delete;
+	OutputBuffer& operator=(const OutputBuffer&) = delete;
+
+	/// Add a line, which must not contain the newline yet.
+	void addLine(const std::string &line)
+	{
+		if (buffer.size() + line.size() + 1 > PIPE_BUF)
+			flush();
+		buffer += line;
+		buffer += '\n';
+	}
+
+	/// Write out the buffer. Errors are ignored, like for output streams.
+	void flush()
+	{
+		const char *data = buffer.data();
+		std::size_t size = buffer.size();
+		while (size > 0) {
+			ssize_t written = ::write(fd, data, size);
+			if (written == -1) {
+				if (errno == EINTR)
+					continue;
+				break;
+			}
+			data += written;
+			size -= written;
+		}
+		buffer.clear();
+	}
+
+private:
+	const int fd;
+	std::string buffer;
+};
+
+/**
+ * Placement of solver threads on CPUs, and of their memory on NUMA nodes.
+ *
+ * Searches allocate their data structures in the thread that runs them. So if
+ * a thread stays on one CPU and allocates locally, its searches use the memory
+ * of the node it runs on. Local allocation is the default of the kernel, but a
+ * process might have been started with another policy.
+ *
+ * This only works on Linux, elsewhere nothing is done.
+ */
+class Placement
+{
+public:
+	/// Can threads be placed on this platform?
+	static bool isSupported()
+	{
+#ifdef __linux__
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	/**
+	 * Set the CPUs to pin threads to, in turn.
+	 * @param list Comma-separated CPU numbers or ranges, like "0-3,8".
+	 * @return False, if the list isn't valid.
+	 */
+	bool setCpus(const char *list);
+
+	/// Let threads allocate memory on the node they run on, overriding the
+	/// policy that the process was started with.
+	void setLocalMemory() { localMemory = true; }
+
+	/// CPUs to pin to, in turn, or empty if threads aren't pinned.
+	const std::vector<unsigned>& getCpus() const { return cpus; }
+
+	/**
+	 * Find a CPU in the list that the process may not run on.
+	 * @param[out] cpu The CPU, if there is one.
+	 * @return False, if all are available.
+	 */
+	bool findUnavailableCpu(unsigned &cpu) const;
+
+	/// Apply to the calling thread, which is the given one of the pool.
+	void apply(unsigned thread) const;
+
+	/// Socket of the CPU that the calling thread runs on, or 0 if unknown.
+	static unsigned currentSocket();
+
+private:
+	std::vector<unsigned> cpus;
+	bool localMemory = false;
+};
+
+#ifdef __linux__
+/// Number of CPUs that we can pin to.
+constexpr unsigned MAX_CPUS = CPU_SETSIZE;
+#else
+constexpr unsigned MAX_CPUS = 0;
+#endif
+
+bool Placement::setCpus(const char *list)
+{
+	cpus.clear();
+	std::istringstream stream(list);
+	do {
+		unsigned first, last;
+		if (!(stream >> first))
+			return false;
+		last = first;
+		if (stream.peek() == '-' && !(stream.ignore() >> last))
+			return false;
+		if (last < first || last >= MAX_CPUS)
+			return false;
+		for (unsigned cpu = first; cpu <= last; ++cpu)
+			cpus.push_back(cpu);
+	} while (stream.peek() == ',' && stream.ignore());
+	return stream.eof();
+}
+
+bool Placement::findUnavailableCpu(unsigned &cpu) const
+{
+#ifdef __linux__
+	cpu_set_t allowed;
+	CPU_ZERO(&allowed);
+	sched_getaffinity(0, sizeof allowed, &allowed);
+	for (unsigned candidate : cpus) {
+		if (!CPU_ISSET(candidate, &allowed)) {
+			cpu = candidate;
+			return true;
+		}
+	}
+#else
+	(void)cpu;
+#endif
+	return false;
+}
+
+void Placement::apply(unsigned thread) const
+{
+#ifdef __linux__
+	if (!cpus.empty()) {
+		unsigned cpu = cpus[thread % cpus.size()];
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		if (pthread_setaffinity_np(pthread_self(), sizeof set, &set) != 0)
+			std::cerr << "Warning: could not pin thread to CPU " << cpu
+			          << ".\n";
+	}
+
+	if (localMemory && syscall(SYS_set_mempolicy, MPOL_LOCAL, nullptr, 0) != 0)
+		std::cerr << "Warning: could not set memory policy.\n";
+#else
+	(void)thread;
+#endif
+}
+
+unsigned Placement::currentSocket()
+{
+#ifdef __linux__
+	// Read the sockets of all CPUs once.
+	static const std::vector<unsigned> sockets = []() {
+		long numCpus = sysconf(_SC_NPROCESSORS_CONF);
+		std::vector<unsigned> sockets(numCpus > 0 ? numCpus : 0, 0);
+		for (unsigned cpu = 0; cpu != sockets.size(); ++cpu) {
+			std::ifstream file("/sys/devices/system/cpu/cpu" +
+			                   std::to_string(cpu) +
+			                   "/topology/physical_package_id");
+			file >> sockets[cpu];
+		}
+		return sockets;
+	}();
+
+	int cpu = sched_getcpu();
+	return cpu >= 0 && static_cast<unsigned>(cpu) < sockets.size()
+		? sockets[cpu] : 0;
+#else
+	return 0;
+#endif
+}
+
+/// How to go about many puzzles of the same size.
+struct ChallengeOptions
+{
+	// Limits of the reorder window, see ReorderWindow.
+	std::size_t windowPuzzles = 1024;
+	std::size_t windowBytes = MemoryBudget::UNLIMITED;
+	// Write results as soon as they are found, tagged with their index.
+	bool unordered = false;
+	// Only measure throughput per socket, instead of writing results.
+	bool bench = false;
+	// Report how long the stages waited for each other.
+	bool printStats = false;
+	Placement placement;
+};
+
+/**
+ * Pipeline for solving many puzzles of the same size.
+ *
+ * One thread reads puzzles from the input, several solve them, and one writes
+ * the results in the order of the input. The stages are connected by bounded
+ * queues, so the reader can't run too far ahead of the solvers. In addition,
+ * the reader pauses when too many puzzles are waiting for their results to be
+ * written, see @ref ReorderWindow. Graphs only exist while a puzzle is being
+ * solved, afterwards we only keep the result.
+ *
+ * If the order doesn't matter, the solvers write their results themselves,
+ * tagged with the index of the puzzle, as soon as they are done. Then there is
+ * no writer. For benchmarks, we only count the puzzles solved on every socket.
+ *
+ * When there are no puzzles left, solvers help with the searches of the
+ * others, if the solver supports that.
+ */
 class PuzzleQueue
 {
-	struct QueueElement
+	/// Puzzle that has been read, but not solved yet.
+	struct Job
+	{
+		std::size_t index;
+		std::string colors;     // Color characters by number.
+		std::vector<color_t> cells;
+	};
+
+	/// Solved puzzle that hasn't been written yet.
+	struct Result
 	{
-		QueueElement(Graph &&graph, std::vector<std::string> &&colors)
-			: graph(std::move(graph)), colors(std::move(colors)) {}
+		std::size_t index;
+		std::string colors;
+		BoundedSequence sequence;
+	};
 
-		Graph graph;
-		const std::vector<std::string> colors;
-		std::vector<color_t> result;
-		bool done = false;
+	/// Puzzles solved on a socket, and the time it took.
+	struct Throughput
+	{
+		std::size_t puzzles = 0;
+		double seconds = 0;
 	};
 
 public:
-	PuzzleQueue(std::istream &input, std::ostream &output, unsigned rows,
-	            unsigned columns, unsigned originRow, unsigned originColumn)
+	/**
+	 * Set up the pipeline.
+	 * @param output Stream for results in order. Unordered results are
+	 *        written to standard output directly.
+	 * @param capacity Number of puzzles each queue can hold.
+	 * @param options Puzzles in the window are charged for their cells and
+	 *        colors until their result is written.
+	 */
+	PuzzleQueue(const MappedFile &input, std::ostream &output, unsigned rows,
+	            unsigned columns, unsigned originRow, unsigned originColumn,
+	            const Solver &solver, HelperPool &helpers, std::size_t capacity,
+	            const ChallengeOptions &options)
 		: input(input), output(output), rows(rows), columns(columns),
-		  originRow(originRow), originColumn(originColumn) {}
+		  originRow(originRow), originColumn(originColumn), solver(solver),
+		  helpers(helpers), options(options), jobs(capacity),
+		  results(capacity),
+		  window(options.windowPuzzles, options.windowBytes) {}
+
+	/// Read puzzles from input until it is exhausted. Run by one thread.
+	void read()
+	{
+		const char *begin = input.begin(), *end;
+		for (std::size_t index = 0; findPuzzle(begin, end); ++index) {
+			Job job{index, std::string(),
+			        std::vector<color_t>(rows * columns)};
+			readPuzzle(begin, end, job.cells, job.colors);
+			window.enter(puzzleBytes(job.colors));
+			jobs.push(std::move(job));
+			begin = end;
+		}
+		jobs.close();
+	}
 
 	/**
-	 * Read puzzles from input and solve them until input is exhausted.
+	 * Solve puzzles that have been read, until there are no more. Then help
+	 * others until all are done.
 	 *
 	 * This function may be run by multiple threads at the same time.
-	 * The results will be in the order of the input, regardless of which puzzle
-	 * is finished first.
 	 */
 	void solve()
 	{
-		std::unique_lock<std::mutex> lock(mutex);
+		OutputBuffer lines(STDOUT_FILENO), messages(STDERR_FILENO);
+		std::map<unsigned, Throughput> sockets;
+		Job job;
+		while (nextJob(job, lines, messages)) {
+			Graph graph = Graph::fromGrid(rows, columns, job.cells,
+			                              originRow * columns + originColumn);
+			auto start = std::chrono::steady_clock::now();
+			Result result{job.index, std::move(job.colors), solver(graph)};
+			if (options.bench) {
+				Throughput &socket = sockets[Placement::currentSocket()];
+				++socket.puzzles;
+				socket.seconds += std::chrono::duration<double>(
+					std::chrono::steady_clock::now() - start).count();
+				window.leave(puzzleBytes(result.colors));
+			}
+			else if (options.unordered)
+				writeUnordered(result, lines, messages);
+			else
+				results.push(std::move(result));
+		}
+		lines.flush();
+		messages.flush();
 
-		while (QueueElement *puzzle = readPuzzle()) {
-			lock.unlock();
+		{
+			std::lock_guard<std::mutex> lock(throughputMutex);
+			for (const auto &pair : sockets) {
+				Throughput &total = throughput[pair.first];
+				total.puzzles += pair.second.puzzles;
+				total.seconds += pair.second.seconds;
+			}
+		}
+		helpers.help();
+	}
 
-			// Reduce graph and solve puzzle. Note that only the ‘done’ flag is
-			// considered shared, so we don't need the lock here.
-			puzzle->graph.reduce();
-			puzzle->result = computeBestSequence(puzzle->graph);
+	/// Signal that all solvers are done.
+	void finish() { results.close(); }
 
-			lock.lock();
-			puzzle->done = true;
+	/**
+	 * Write results in the order of the input, until all solvers are done.
+	 * Run by one thread.
+	 */
+	void write()
+	{
+		Result result;
+		while (results.pop(result)) {
+			std::size_t index = result.index;
+			pending.emplace(index, std::move(result));
 			flushResults();
 		}
 	}
 
-private:
 	/**
-	 * Read and enqueue a puzzle from the input.
-	 *
-	 * We need to produce the solutions in the order of input, so we store them
-	 * immediately in a queue after having read them.
-	 *
-	 * @note Assumes that @ref mutex is held.
-	 *
-	 * @return Pointer to enqueued puzzle, if available, otherwise nullptr.
+	 * Report the puzzles solved on every socket.
+	 * @param seconds Time for all puzzles.
 	 */
-	QueueElement* readPuzzle()
+	void printThroughput(std::ostream &stream, double seconds) const
 	{
-		ColorArray array(rows, columns, originRow, originColumn);
+		std::size_t puzzles = 0;
+		for (const auto &pair : throughput) {
+			const Throughput &socket = pair.second;
+			stream << "Socket " << pair.first << ": " << socket.puzzles
+			       << " puzzles, " << socket.puzzles / seconds
+			       << " per second, " << 1000 * socket.seconds / socket.puzzles
+			       << " ms each\n";
+			puzzles += socket.puzzles;
+		}
+		stream << "Total: " << puzzles << " puzzles in " << seconds << " s, "
+		       << puzzles / seconds << " per second\n";
+	}
 
-		unsigned row = 0, column = 0;
-		char digit;
+	/// Report how long the stages have waited for each other.
+	void printStats(std::ostream &stream) const
+	{
+		printWaits(stream, "Reader waited for writer", window.getStats());
+		printWaits(stream, "Reader waited for solvers",
+		           jobs.getPushStats());
+		printWaits(stream, "Solvers waited for reader",
+		           jobs.getPopStats());
+		printWaits(stream, "Solvers waited for writer",
+		           results.getPushStats());
+		printWaits(stream, "Writer waited for solvers",
+		           results.getPopStats());
+	}
 
-		while (input >> digit) {
-			array.setColor(row, column, {digit});
+private:
+	/// Whitespace, as skipped by formatted input in the "C" locale.
+	static bool isSpace(char c)
+	{
+		return c == ' ' || (c >= '\t' && c <= '\r');
+	}
 
-			// Go to next position.
-			if (++row != rows)
-				continue;
-			row = 0;
+	/// Take the next puzzle, but write out our results before waiting for it.
+	bool nextJob(Job &job, OutputBuffer &lines, OutputBuffer &messages)
+	{
+		if (jobs.tryPop(job))
+			return true;
+		lines.flush();
+		messages.flush();
+		return jobs.pop(job);
+	}
 
-			if (++column != columns)
-				continue;
+	/// Add a result tagged with its index to the output of a solver.
+	void writeUnordered(const Result &result, OutputBuffer &lines,
+	                    OutputBuffer &messages)
+	{
+		const std::vector<color_t> &moves = result.sequence.moves;
+		std::string line = std::to_string(result.index);
+		line += ' ';
+		for (unsigned move = 1; move < moves.size(); ++move)
+			line += result.colors[moves[move]];
+		lines.addLine(line);
 
-			// Build the puzzle, enqueue it and return a pointer.
-			queue.emplace(array.createGraph(), array.getColors());
-			return &queue.back();
-		}
+		unsigned lowerBound = result.sequence.lowerBound;
+		if (lowerBound < moves.size() - 1)
+			messages.addLine("Puzzle " + std::to_string(result.index) + ": " +
+			                 std::to_string(moves.size() - 1) +
+			                 " moves, at least " + std::to_string(lowerBound) +
+			                 " needed");
+		window.leave(puzzleBytes(result.colors));
+	}
 
-		return nullptr;
+	/// Bytes to charge a puzzle with in the window.
+	std::size_t puzzleBytes(const std::string &colors) const
+	{
+		return rows * columns * sizeof(color_t) + colors.size();
 	}
 
 	/**
-	 * Flush results from the front of the queue to output stream.
+	 * Find the extent of the next puzzle in the input.
 	 *
-	 * @note Assumes that @ref mutex is held.
+	 * @param begin Start of the puzzle, including preceding whitespace.
+	 * @param[out] end End of the puzzle, where the next one starts.
+	 * @return False, if there is no complete puzzle left.
 	 */
+	bool findPuzzle(const char *begin, const char *&end) const
+	{
+		end = begin;
+		for (unsigned cell = 0; cell != rows * columns; ++cell, ++end) {
+			while (end != input.end() && isSpace(*end))
+				++end;
+			if (end == input.end())
+				return false;
+		}
+		return true;
+	}
+
+	/**
+	 * Read a puzzle of single-character colors, given column by column.
+	 *
+	 * Colors are numbered in the order of their characters.
+	 *
+	 * @param[out] cells Colors of the cells in row-major order.
+	 * @param[out] colors Characters of the colors by number.
+	 */
+	void readPuzzle(const char *begin, const char *end,
+	                std::vector<color_t> &cells, std::string &colors)
+	{
+		// Find the colors that appear, then number them.
+		bool present[256] = {};
+		for (const char *c = begin; c != end; ++c)
+			present[static_cast<unsigned char>(*c)] = true;
+		color_t numbers[256];
+		colors.clear();
+		for (unsigned c = 0; c != 256; ++c) {
+			if (present[c] && !isSpace(c)) {
+				numbers[c] = colors.size();
+				colors.push_back(c);
+			}
+		}
+
+		unsigned row = 0, column = 0;
+		for (const char *c = begin; c != end; ++c) {
+			if (isSpace(*c))
+				continue;
+			unsigned char color = *c;
+			cells[row * columns + column] = numbers[color];
+			if (++row == rows) {
+				row = 0;
+				++column;
+			}
+		}
+	}
+
+	/// Write the pending results that are next in the order of input.
 	void flushResults()
 	{
-		while (!queue.empty() && queue.front().done) {
-			const std::vector<color_t> &result = queue.front().result;
-			const std::vector<std::string> &colors = queue.front().colors;
-			for (unsigned move = 1; move < result.size(); ++move)
-				output << colors[result[move]];
+		std::map<std::size_t, Result>::iterator it;
+		while ((it = pending.begin()) != pending.end() &&
+		       it->first == numFlushed) {
+			const Result &result = it->second;
+			const std::vector<color_t> &moves = result.sequence.moves;
+			for (unsigned move = 1; move < moves.size(); ++move)
+				output << result.colors[moves[move]];
 			output << '\n';
-			queue.pop();
+
+			// Sequences that might not be optimal are reported separately, so
+			// that the output format stays the same.
+			unsigned lowerBound = result.sequence.lowerBound;
+			if (lowerBound < moves.size() - 1)
+				std::cerr << "Puzzle " << numFlushed << ": " << moves.size() - 1
+				          << " moves, at least " << lowerBound << " needed\n";
+			++numFlushed;
+			window.leave(puzzleBytes(result.colors));
+			pending.erase(it);
 		}
 	}
 
-private:
-	// Protecting the members against data races, but not the queue elements in
-	// progress, which are private to the thread that added them to the queue.
-	std::mutex mutex;
+	template<typename WaitStats>
+	static void printWaits(std::ostream &stream, const char *what,
+	                       const WaitStats &stats)
+	{
+		stream << what << ' ' << stats.seconds << " s in " << stats.waits
+		       << " waits\n";
+	}
 
+private:
 	// Input and output.
-	std::istream &input;
+	const MappedFile &input;
 	std::ostream &output;
 
 	// Problem dimensions.
 	const unsigned rows, columns;
 	const unsigned originRow, originColumn;
 
-	// Puzzle queue.
-	std::queue<QueueElement> queue;
+	const Solver &solver;
+	HelperPool &helpers;
+	const ChallengeOptions &options;
+
+	// Puzzles from the reader to the solvers, results from there to the writer.
+	BoundedQueue<Job> jobs;
+	BoundedQueue<Result> results;
+	ReorderWindow window;
+
+	// Results that can't be written yet, by index in the input, and the number
+	// of results written. Only used by the writer.
+	std::map<std::size_t, Result> pending;
+	std::size_t numFlushed = 0;
+
+	// Puzzles solved by socket, for benchmarks.
+	std::mutex throughputMutex;
+	std::map<unsigned, Throughput> throughput;
 };
 
 } // anonymous namespace
@@ -218,86 +801,378 @@ static ColorArray readData(std::istream &input)
 	return array;
 }
 
-static void solvePuzzle(std::istream &input)
+static void solvePuzzle(std::istream &input, const Solver &solver)
 {
 	ColorArray array = readData(input);
 	Graph graph = array.createGraph();
-	graph.reduce();
-	std::vector<color_t> result = computeBestSequence(graph);
+	BoundedSequence solution = solver(graph);
+	const std::vector<color_t> &result = solution.moves;
 
 	std::vector<std::string> colors = array.getColors();
-	std::cout << "A shortest sequence of " << result.size() - 1
-	          << " moves is given by:\n\n    [" << colors[result[0]] << "]";
+	if (solution.lowerBound == result.size() - 1)
+		std::cout << "A shortest sequence of " << result.size() - 1
+		          << " moves is given by:";
+	else
+		std::cout << "A sequence of " << result.size() - 1
+		          << " moves (at least " << solution.lowerBound
+		          << " needed) is given by:";
+	std::cout << "\n\n    [" << colors[result[0]] << "]";
 	for (unsigned move = 1; move < result.size(); ++move)
 		std::cout << " " << colors[result[move]];
 	std::cout << '\n';
 }
 
 static void solvePuzzleChallenge(
-	std::istream &input,
+	const MappedFile &input,
 	unsigned rows, unsigned columns,
-	unsigned originRow, unsigned originColumn)
+	unsigned originRow, unsigned originColumn,
+	const Solver &solver, HelperPool &helpers, const ChallengeOptions &options)
 {
-	PuzzleQueue queue(input, std::cout, rows, columns, originRow, originColumn);
+	// A few puzzles per solver, so that they don't wait for the reader.
+	unsigned numThreads = helpers.size();
+	PuzzleQueue queue(input, std::cout, rows, columns, originRow, originColumn,
+	                  solver, helpers, 4 * numThreads, options);
+	auto start = std::chrono::steady_clock::now();
 
-	// Fire up worker threads solving puzzles.
-	unsigned numThreads = std::thread::hardware_concurrency();
-	std::vector<std::thread> threads;
-	threads.reserve(numThreads);
-	for (unsigned thread = 0; thread != numThreads; ++thread)
-		threads.emplace_back([&queue](){ queue.solve(); });
+	// Fire up the reader, the solvers and the writer, if we need one. Solvers
+	// are placed before they allocate anything.
+	std::thread reader([&queue](){ queue.read(); });
+	std::vector<std::thread> solvers;
+	solvers.reserve(numThreads);
+	for (unsigned thread = 0; thread != numThreads; ++thread) {
+		solvers.emplace_back([&queue, &options, thread]() {
+			options.placement.apply(thread);
+			queue.solve();
+		});
+	}
+	std::thread writer;
+	if (!options.unordered && !options.bench)
+		writer = std::thread([&queue](){ queue.write(); });
 
 	// Wait until all are done.
-	for (auto &thread : threads)
+	reader.join();
+	for (auto &thread : solvers)
 		thread.join();
+	queue.finish();
+	if (writer.joinable())
+		writer.join();
+
+	if (options.bench) {
+		queue.printThroughput(std::cerr, std::chrono::duration<double>(
+			std::chrono::steady_clock::now() - start).count());
+	}
+	if (options.printStats)
+		queue.printStats(std::cerr);
+}
+
+static void printUsage(const char *program)
+{
+	std::cout <<
+		"Usage: " << program << " [options] filename\n"
+		"       " << program
+		<< " [options] rows columns [row column] filename\n"
+		"\n"
+		"In the first variant, the file should have the number of rows and "
+		"columns in the first line, the row and column index of the origin "
+		"cell (0-based) in the second, and then the colors of each cell, "
+		"all separated by spaces. "
+		"The colors are strings of non-whitespace characters.\n"
+		"\n"
+		"In the second variant, the file may contain multiple puzzles, "
+		"given by rows x columns single-character colors. Optionally, the "
+		"origin cell may be given by row and column index (0-based), "
+		"otherwise (0, 0) is assumed.\n"
+		"\n"
+		"Options:\n"
+		"  -a, --algorithm=NAME  Search algorithm: 'astar' (default), 'ida' "
+		"for iterative deepening A*, which needs much less memory, but more "
+		"time, or 'hda' for hash-distributed A*, which solves a single puzzle "
+		"with multiple threads.\n"
+		"  -j, --threads=N       Number of threads, by default one per core. "
+		"With 'hda' these search together on one puzzle at a time, otherwise "
+		"each thread solves its own puzzles. With 'astar', threads that "
+		"have none left join the remaining searches. "
+		"With --cpus, one per CPU in the list.\n"
+		"  -w, --weight=W        Use weighted A*, which expands states by "
+		"moves so far plus W times the lower bound for moves left. For W > 1 "
+		"this is faster, but sequences can have up to W times as many moves "
+		"as necessary. W is rounded down to eighths. A proven lower bound is "
+		"reported if the sequence might not be optimal, for multiple puzzles "
+		"on standard error.\n"
+		"  -t, --improve=SECONDS With --weight, keep searching for better "
+		"sequences for this long after the first one.\n"
+		"  -b, --breadth-first   Renumber the nodes of the reduced graph in "
+		"breadth-first order from the origin before solving. This can make "
+		"large graphs more cache-friendly.\n"
+		"  -m, --memory=MB       Memory that all searches together may use. "
+		"With 'astar', a search that runs out continues with iterative "
+		"deepening, or with --weight returns the best sequence so far.\n"
+		"      --search-memory=MB  Memory that a single search may use.\n"
+		"  -s, --spill=DIR       With 'astar', keep the states that haven't "
+		"been expanded in files in DIR instead of memory. This is slower, but "
+		"can solve much larger puzzles.\n"
+		"      --window=N        With multiple puzzles, read at most N "
+		"(default 1024) starting from the first one whose result hasn't been "
+		"written. A hard puzzle holds back the output of all after it, which "
+		"then have to be kept in memory.\n"
+		"      --window-memory=MB  Memory that these puzzles may use.\n"
+		"  -u, --unordered       With multiple puzzles, write every sequence "
+		"as soon as it is found, preceded by the index of the puzzle (0-based) "
+		"and a space.\n"
+		"      --stats           With multiple puzzles, report on standard "
+		"error how long reading, solving and writing waited for each other.\n"
+		"      --cpus=LIST       With multiple puzzles, pin the threads "
+		"solving them to the CPUs in LIST, like '0-3,8', in turn. Threads of "
+		"'hda' searches aren't pinned.\n"
+		"      --numa-local      With multiple puzzles, let the threads "
+		"solving them allocate their searches on the NUMA node they run on. "
+		"The kernel does that by default, so this only matters if the "
+		"process was started with another memory policy, like by numactl "
+		"--interleave. Best together with --cpus. Both only work on Linux.\n"
+		"      --bench           With multiple puzzles, don't write "
+		"sequences, but report on standard error how many puzzles were solved "
+		"on every socket, and how long they took.\n";
 }
 
 int main(int argc, char **argv)
 {
-	if (argc == 2) {
-		std::ifstream file(argv[1]);
+	std::string algorithm = "astar";
+	unsigned numThreads = std::max(1u, std::thread::hardware_concurrency());
+	bool breadthFirst = false;
+	double weight = 0, improveFor = 0;
+	std::size_t memoryLimit = MemoryBudget::UNLIMITED;
+	std::size_t searchMemoryLimit = MemoryBudget::UNLIMITED;
+	std::string spillDirectory;
+	bool threadsGiven = false;
+	ChallengeOptions challenge;
+
+	static const option longOptions[] = {
+		{"algorithm", required_argument, nullptr, 'a'},
+		{"threads", required_argument, nullptr, 'j'},
+		{"weight", required_argument, nullptr, 'w'},
+		{"improve", required_argument, nullptr, 't'},
+		{"breadth-first", no_argument, nullptr, 'b'},
+		{"memory", required_argument, nullptr, 'm'},
+		{"search-memory", required_argument, nullptr, 'M'},
+		{"spill", required_argument, nullptr, 's'},
+		{"window", required_argument, nullptr, 'W'},
+		{"window-memory", required_argument, nullptr, 'X'},
+		{"unordered", no_argument, nullptr, 'u'},
+		{"stats", no_argument, nullptr, 'S'},
+		{"cpus", required_argument, nullptr, 'C'},
+		{"numa-local", no_argument, nullptr, 'N'},
+		{"bench", no_argument, nullptr, 'B'},
+		{nullptr, 0, nullptr, 0}
+	};
+
+	int opt;
+	while ((opt = getopt_long(argc, argv, "a:j:w:t:bm:s:u", longOptions,
+	                          nullptr)) != -1) {
+		switch (opt) {
+		case 'a':
+			algorithm = optarg;
+			break;
+		case 'j':
+			std::istringstream(optarg) >> numThreads;
+			if (numThreads == 0) {
+				std::cerr << "Error: invalid number of threads '" << optarg
+				          << "'.\n";
+				return 1;
+			}
+			threadsGiven = true;
+			break;
+		case 'w':
+			std::istringstream(optarg) >> weight;
+			if (!(weight >= 1)) {
+				std::cerr << "Error: invalid weight '" << optarg
+				          << "', must be at least 1.\n";
+				return 1;
+			}
+			break;
+		case 't':
+			std::istringstream(optarg) >> improveFor;
+			if (!(improveFor >= 0)) {
+				std::cerr << "Error: invalid time '" << optarg << "'.\n";
+				return 1;
+			}
+			break;
+		case 'b':
+			breadthFirst = true;
+			break;
+		case 'm':
+		case 'M': {
+			std::size_t megabytes = 0;
+			std::istringstream(optarg) >> megabytes;
+			if (megabytes == 0) {
+				std::cerr << "Error: invalid memory size '" << optarg
+				          << "'.\n";
+				return 1;
+			}
+			(opt == 'm' ? memoryLimit : searchMemoryLimit) = megabytes << 20;
+			break;
+		}
+		case 's':
+			spillDirectory = optarg;
+			break;
+		case 'W':
+			challenge.windowPuzzles = 0;
+			std::istringstream(optarg) >> challenge.windowPuzzles;
+			if (challenge.windowPuzzles == 0) {
+				std::cerr << "Error: invalid number of puzzles '" << optarg
+				          << "'.\n";
+				return 1;
+			}
+			break;
+		case 'X': {
+			std::size_t megabytes = 0;
+			std::istringstream(optarg) >> megabytes;
+			if (megabytes == 0) {
+				std::cerr << "Error: invalid memory size '" << optarg
+				          << "'.\n";
+				return 1;
+			}
+			challenge.windowBytes = megabytes << 20;
+			break;
+		}
+		case 'u':
+			challenge.unordered = true;
+			break;
+		case 'S':
+			challenge.printStats = true;
+			break;
+		case 'C':
+		case 'N':
+			if (!Placement::isSupported()) {
+				std::cerr << "Error: --cpus and --numa-local only work on "
+				             "Linux.\n";
+				return 1;
+			}
+			if (opt == 'N')
+				challenge.placement.setLocalMemory();
+			else if (!challenge.placement.setCpus(optarg)) {
+				std::cerr << "Error: invalid list of CPUs '" << optarg
+				          << "'.\n";
+				return 1;
+			}
+			break;
+		case 'B':
+			challenge.bench = true;
+			break;
+		default:
+			printUsage(argv[0]);
+			return 1;
+		}
+	}
+
+	const std::vector<unsigned> &cpus = challenge.placement.getCpus();
+	if (!cpus.empty()) {
+		unsigned cpu;
+		if (challenge.placement.findUnavailableCpu(cpu)) {
+			std::cerr << "Error: CPU " << cpu << " isn't available.\n";
+			return 1;
+		}
+		if (!threadsGiven)
+			numThreads = cpus.size();
+	}
+
+	// The puzzle threads, and the threads per puzzle.
+	unsigned numPuzzleThreads = numThreads, numSearchThreads = 1;
+	if (algorithm == "hda")
+		std::swap(numPuzzleThreads, numSearchThreads);
+	MemoryBudget budget(memoryLimit, searchMemoryLimit);
+	bool memoryLimited = memoryLimit != MemoryBudget::UNLIMITED ||
+	                     searchMemoryLimit != MemoryBudget::UNLIMITED;
+	// Puzzle threads that are done help with the searches of the others.
+	HelperPool helpers(numPuzzleThreads);
+	Solver solver;
+	if (algorithm == "astar" && weight > 0) {
+		solver = [weight, improveFor, &budget](const Graph &graph) {
+			return computeBoundedSequence(graph, weight, improveFor, budget);
+		};
+	}
+	else if (algorithm == "astar" && !spillDirectory.empty()) {
+		solver = exactSolver([spillDirectory](const Graph &graph)
+			{ return computeBestSequenceExternal(graph, spillDirectory); });
+	}
+	else if (algorithm == "astar") {
+		solver = exactSolver([&budget, &helpers](const Graph &graph)
+			{ return computeBestSequence(graph, budget, helpers); });
+	}
+	else if (algorithm == "ida")
+		solver = exactSolver(computeBestSequenceIDA);
+	else if (algorithm == "hda") {
+		solver = exactSolver([numSearchThreads](const Graph &graph)
+			{ return computeBestSequenceParallel(graph, numSearchThreads); });
+	}
+	else {
+		std::cerr << "Error: unknown algorithm '" << algorithm << "'.\n";
+		return 1;
+	}
+
+	if (weight > 0 && algorithm != "astar") {
+		std::cerr << "Error: --weight only works with algorithm 'astar'.\n";
+		return 1;
+	}
+	if (improveFor > 0 && weight == 0) {
+		std::cerr << "Error: --improve needs --weight.\n";
+		return 1;
+	}
+	if (memoryLimited && algorithm != "astar") {
+		std::cerr << "Error: --memory and --search-memory only work with "
+		             "algorithm 'astar'.\n";
+		return 1;
+	}
+	if (!spillDirectory.empty() &&
+	    (algorithm != "astar" || weight > 0 || memoryLimited)) {
+		std::cerr << "Error: --spill only works with algorithm 'astar', "
+		             "without --weight and memory limits.\n";
+		return 1;
+	}
+
+	if (breadthFirst) {
+		solver = [solver](const Graph &graph) {
+			Graph renumbered(graph);
+			renumbered.renumberBreadthFirst();
+			return solver(renumbered);
+		};
+	}
+
+	// Remaining positional arguments.
+	char **args = argv + optind;
+	int numArgs = argc - optind;
+
+	if (numArgs == 1) {
+		std::ifstream file(args[0]);
 		if (file.fail()) {
-			std::cerr << "Error: could not open file '" << argv[1] << "'.\n";
+			std::cerr << "Error: could not open file '" << args[0] << "'.\n";
 			return 1;
 		}
 
-		solvePuzzle(file);
+		solvePuzzle(file, solver);
 	}
-	else if (argc == 4 || argc == 6) {
+	else if (numArgs == 3 || numArgs == 5) {
 		unsigned rows, columns;
-		std::istringstream(argv[1]) >> rows;
-		std::istringstream(argv[2]) >> columns;
+		std::istringstream(args[0]) >> rows;
+		std::istringstream(args[1]) >> columns;
 
 		unsigned originRow = 0, originColumn = 0;
-		if (argc == 6) {
-			std::istringstream(argv[3]) >> originRow;
-			std::istringstream(argv[4]) >> originColumn;
+		if (numArgs == 5) {
+			std::istringstream(args[2]) >> originRow;
+			std::istringstream(args[3]) >> originColumn;
 		}
 
-		std::ifstream file(argv[argc-1]);
+		MappedFile file(args[numArgs-1]);
 		if (file.fail()) {
-			std::cerr << "Error: could not open file '" << argv[argc-1]
+			std::cerr << "Error: could not open file '" << args[numArgs-1]
 			          << "'.\n";
 			return 1;
 		}
 
-		solvePuzzleChallenge(file, rows, columns, originRow, originColumn);
+		solvePuzzleChallenge(file, rows, columns, originRow, originColumn,
+		                     solver, helpers, challenge);
 	}
 	else {
-		std::cout <<
-			"Usage: " << argv[0] << " filename\n"
-			"       " << argv[0] << " rows columns [row column] filename\n"
-			"\n"
-			"In the first variant, the file should have the number of rows and "
-			"columns in the first line, the row and column index of the origin "
-			"cell (0-based) in the second, and then the colors of each cell, "
-			"all separated by spaces. "
-			"The colors are strings of non-whitespace characters.\n"
-			"\n"
-			"In the second variant, the file may contain multiple puzzles, "
-			"given by rows x columns single-character colors. Optionally, the "
-			"origin cell may be given by row and column index (0-based), "
-			"otherwise (0, 0) is assumed.\n";
+		printUsage(argv[0]);
 		return 1;
 	}
 }
@@ -0,0 +1,526 @@
+/**
+ * Hash-distributed A^* (HDA^*): every state is owned by one thread, determined
+ * by the hash of its filled region. Each thread has its own open list and
+ * transposition table, and expands only the states it owns. Children owned by
+ * other threads are sent to them through lock-free mailboxes.
+ *
+ * Since duplicates always end up at the same thread, duplicate detection works
+ * just like in the sequential search. But threads don't expand states in
+ * global order, so the first solution found isn't necessarily optimal. We keep
+ * the best solution found so far and prune states that can't improve on it.
+ * The search is over when no state is left anywhere, which we track with a
+ * global counter of states that haven't been expanded or pruned.
+ *
+ * A sequential A^* search can also be continued this way when other threads
+ * become idle. It starts out with a single thread, which owns all states, and
+ * threads join by adding partitions. Then every thread hands the states it no
+ * longer owns to their new owners. Duplicates might be missed when ownership
+ * changes, but since all open states are expanded, the result is still optimal.
+ * Such a search stays within its memory budget: if the threads together would
+ * exceed it, they stop, and the sequential search goes on from the smallest
+ * valuation of the states that are left.
+ *
+ * Threads that have nothing to do wait until states are sent to them, so that
+ * they don't take time from other threads, like those solving other puzzles.
+ */
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <limits>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "concurrenttrie.hpp"
+
+namespace {
+
+/**
+ * Batch of states sent to another thread.
+ */
+struct Batch
+{
+	Batch *next;
+	std::vector<State> states;
+};
+
+/**
+ * Multiple-producer single-consumer queue of batches.
+ *
+ * Producers push onto a lock-free stack, the consumer takes the whole stack at
+ * once, so there is no ABA problem.
+ */
+class Mailbox
+{
+public:
+	Mailbox() : head(nullptr) {}
+
+	~Mailbox()
+	{
+		for (Batch *batch = collect(), *next; batch; batch = next) {
+			next = batch->next;
+			delete batch;
+		}
+	}
+
+	void post(Batch *batch)
+	{
+		batch->next = head.load(std::memory_order_relaxed);
+		while (!head.compare_exchange_weak(batch->next, batch,
+			std::memory_order_release, std::memory_order_relaxed));
+	}
+
+	/// Have no batches been posted since the last time they were collected?
+	bool empty() const
+	{
+		return head.load(std::memory_order_acquire) == nullptr;
+	}
+
+	/// @return All batches posted so far, or nullptr if there are none.
+	Batch* collect()
+	{
+		return head.exchange(nullptr, std::memory_order_acquire);
+	}
+
+private:
+	std::atomic<Batch*> head;
+};
+
+class ParallelSearch : public HelperPool::Search
+{
+public:
+	ParallelSearch(const Graph &graph, unsigned numThreads);
+
+	/**
+	 * Prepare to continue a sequential search, see @ref continueParallel.
+	 * @param maxThreads Number of threads that might work on it.
+	 */
+	ParallelSearch(const Graph &graph, unsigned maxThreads,
+	               BucketQueue<StateArena::Handle> &&queue, StateArena &&arena,
+	               TranspositionTable &&table, MemoryBudget::Account &account,
+	               std::size_t retained);
+
+	std::vector<color_t> run();
+	bool resume(unsigned bound, HelperPool &helpers,
+	            std::vector<color_t> &solution, unsigned &lowerBound);
+	void help() override;
+
+private:
+	/// State that belongs to one thread.
+	struct Worker
+	{
+		Worker(const Graph &graph, unsigned partitions)
+			: arena(graph), partitions(partitions) {}
+		Worker(BucketQueue<StateArena::Handle> &&queue, StateArena &&arena,
+		       TranspositionTable &&table)
+			: queue(std::move(queue)), arena(std::move(arena)),
+			  table(std::move(table)), partitions(1) {}
+
+		BucketQueue<StateArena::Handle> queue;
+		StateArena arena;
+		TranspositionTable table;
+		Mailbox mailbox;
+		// Outgoing states by destination thread.
+		std::vector<std::vector<State>> outgoing;
+		// Number of threads that states are distributed over.
+		unsigned partitions;
+		// Bytes used by the thread, as of the last check.
+		std::atomic<std::size_t> usage{0};
+		// To wait for states when there is nothing to do.
+		std::mutex mutex;
+		std::condition_variable wakeup;
+	};
+
+	void work(unsigned index);
+	unsigned owner(const State &state, unsigned partitions) const;
+	void redistribute(Worker &worker, unsigned index, State &state);
+	void send(Worker &worker, unsigned destination, const State &state);
+	void flush(Worker &worker, unsigned destination);
+	void receive(Worker &worker);
+	void enqueue(Worker &worker, const State &state);
+	void finish();
+	void wait(Worker &worker);
+	void wake(Worker &worker);
+	void wakeAll();
+	void charge(Worker &worker, const State::MoveTrie &localTrie);
+	unsigned lowestValuation();
+
+private:
+	// Number of states to collect before sending them.
+	static constexpr std::size_t BATCH_SIZE = 64;
+	// Number of expansions after which we send all outgoing states.
+	static constexpr unsigned FLUSH_INTERVAL = 256;
+	// Number of times a thread looks for states before it waits.
+	static constexpr unsigned IDLE_ROUNDS = 64;
+	// Number of expansions after which we update the memory usage.
+	static constexpr unsigned MEMORY_CHECK_INTERVAL = 4 * FLUSH_INTERVAL;
+
+	const Graph &graph;
+	std::deque<Worker> workers;
+	// Number of workers that have a thread. Only grows.
+	std::atomic<unsigned> numActive;
+	// Moves of all states. Threads continue sequences of others.
+	ConcurrentTrie<color_t, MOVE_BITS> trie;
+
+	// Number of states that haven't been expanded or pruned yet.
+	std::atomic<std::size_t> pending;
+
+	// Account for the memory of all threads, if there is a budget, and bytes
+	// used outside of the search.
+	MemoryBudget::Account *account;
+	std::size_t retained;
+	std::mutex accountMutex;
+	// Approximate bytes of a state, and number of states sent but not yet
+	// received.
+	const std::size_t stateBytes;
+	std::atomic<std::size_t> inTransit;
+	// Set when the budget runs out, then all threads stop.
+	std::atomic<bool> stopped;
+
+	// Best solution so far and its valuation.
+	std::atomic<unsigned> bound;
+	std::mutex solutionMutex;
+	std::vector<color_t> solution;
+};
+
+ParallelSearch::ParallelSearch(const Graph &graph, unsigned numThreads)
+	: graph(graph), numActive(numThreads), pending(0), account(nullptr),
+	  retained(0), stateBytes(sizeof(State) +
+	                          State::getRecordSize(graph) * sizeof(bits::word_t)),
+	  inTransit(0), stopped(false), bound(std::numeric_limits<unsigned>::max())
+{
+	for (unsigned index = 0; index != numThreads; ++index) {
+		workers.emplace_back(graph, numThreads);
+		workers.back().outgoing.resize(numThreads);
+	}
+}
+
+ParallelSearch::ParallelSearch(const Graph &graph, unsigned maxThreads,
+                               BucketQueue<StateArena::Handle> &&queue,
+                               StateArena &&arena, TranspositionTable &&table,
+                               MemoryBudget::Account &account,
+                               std::size_t retained)
+	: graph(graph), numActive(1), pending(queue.size()), account(&account),
+	  retained(retained), stateBytes(sizeof(State) +
+	                          State::getRecordSize(graph) * sizeof(bits::word_t)),
+	  inTransit(0), stopped(false), bound(std::numeric_limits<unsigned>::max())
+{
+	workers.emplace_back(std::move(queue), std::move(arena), std::move(table));
+	for (unsigned index = 1; index < maxThreads; ++index)
+		workers.emplace_back(graph, 1);
+	for (Worker &worker : workers)
+		worker.outgoing.resize(maxThreads);
+}
+
+std::vector<color_t> ParallelSearch::run()
+{
+	// Start with a quick solution as the best so far. Done states have one
+	// more than their number of moves as valuation.
+	solution = computeGreedySequence(graph);
+	if (!solution.empty())
+		bound = solution.size() + 1;
+
+	State initial(graph, trie.local());
+	pending = 1;
+	enqueue(workers[owner(initial, workers.size())], initial);
+
+	std::vector<std::thread> threads;
+	threads.reserve(workers.size());
+	for (unsigned index = 0; index != workers.size(); ++index)
+		threads.emplace_back([this, index]() { work(index); });
+	for (std::thread &thread : threads)
+		thread.join();
+
+	// If we didn't find any way to flood fill the entire graph, then it's
+	// probably not connected.
+	if (solution.empty())
+		throw std::runtime_error("Graph seems to be not connected");
+	return std::move(solution);
+}
+
+bool ParallelSearch::resume(unsigned bound, HelperPool &helpers,
+                            std::vector<color_t> &solution,
+                            unsigned &lowerBound)
+{
+	this->bound = bound;
+	helpers.offer(*this, workers.size() - 1);
+	work(0);
+	helpers.withdraw(*this);
+	solution = std::move(this->solution);
+	if (!stopped)
+		return true;
+
+	// If no state that is left can improve on the best solution, it's optimal,
+	// even though we ran out of memory.
+	lowerBound = lowestValuation();
+	return lowerBound >= this->bound;
+}
+
+void ParallelSearch::help()
+{
+	// We get at most as many helpers as there are workers left.
+	work(numActive.fetch_add(1, std::memory_order_acq_rel));
+}
+
+unsigned ParallelSearch::owner(const State &state, unsigned partitions) const
+{
+	// The transposition tables use the lower bits, so we take the upper.
+	return ((state.getHash() >> 32) * partitions) >> 32;
+}
+
+void ParallelSearch::work(unsigned index)
+{
+	Worker &worker = workers[index];
+	State::MoveTrie &localTrie = trie.local();
+	unsigned expansions = 0, idleRounds = 0;
+
+	// We load states into these instead of creating new ones.
+	State state(graph, localTrie);
+	State nextState = state;
+
+	while (pending.load(std::memory_order_acquire) != 0 &&
+	       !stopped.load(std::memory_order_relaxed)) {
+		receive(worker);
+
+		if (worker.queue.empty() || ++expansions % FLUSH_INTERVAL == 0) {
+			// Give away what we no longer own, if threads have joined.
+			if (worker.partitions !=
+			    numActive.load(std::memory_order_acquire))
+				redistribute(worker, index, state);
+
+			// Don't keep others waiting for states.
+			for (unsigned destination = 0; destination != workers.size();
+			     ++destination)
+				flush(worker, destination);
+
+			if (account && !worker.queue.empty() &&
+			    expansions % MEMORY_CHECK_INTERVAL == 0)
+				charge(worker, localTrie);
+		}
+
+		if (worker.queue.empty()) {
+			// Others will likely send states soon. If not, we wait for them.
+			if (++idleRounds < IDLE_ROUNDS)
+				std::this_thread::yield();
+			else
+				wait(worker);
+			continue;
+		}
+		idleRounds = 0;
+
+		StateArena::Handle handle = worker.queue.pop();
+		worker.arena.load(handle, state);
+		worker.arena.release(handle);
+
+		// Skip states that can't improve on the best solution, or whose region
+		// has since been reached in fewer moves.
+		if (state.getValuation() >= bound.load(std::memory_order_relaxed) ||
+		    worker.table.lookup(state.getHash()) < state.getNumMoves()) {
+			finish();
+			continue;
+		}
+
+		if (state.done(graph)) {
+			std::lock_guard<std::mutex> lock(solutionMutex);
+			if (state.getValuation() < bound.load(std::memory_order_relaxed)) {
+				solution = state.materializeMoves();
+				bound.store(state.getValuation(), std::memory_order_relaxed);
+			}
+			finish();
+			continue;
+		}
+
+		// Try all colors but the last one used.
+		color_t numColors = graph.getColorCounts().size();
+		for (color_t next = 0; next < numColors; ++next) {
+			if (next == state.getLastColor())
+				continue;
+
+			nextState = state;
+			if (!nextState.move(graph, localTrie, next))
+				continue;
+			if (nextState.getValuation() >=
+			    bound.load(std::memory_order_relaxed))
+				continue;
+
+			pending.fetch_add(1, std::memory_order_relaxed);
+			unsigned destination = owner(nextState, worker.partitions);
+			if (destination == index)
+				enqueue(worker, nextState);
+			else
+				send(worker, destination, nextState);
+		}
+
+		finish();
+	}
+}
+
+void ParallelSearch::redistribute(Worker &worker, unsigned index,
+                                  State &state)
+{
+	worker.partitions = numActive.load(std::memory_order_acquire);
+
+	std::vector<StateArena::Handle> handles;
+	handles.reserve(worker.queue.size());
+	while (!worker.queue.empty())
+		handles.push_back(worker.queue.pop());
+
+	// Keep the order of the states we still own.
+	for (StateArena::Handle handle : handles) {
+		worker.arena.load(handle, state);
+		unsigned destination = owner(state, worker.partitions);
+		if (destination == index)
+			worker.queue.push(state.getValuation(), state.getNumMoves(),
+			                  std::move(handle));
+		else {
+			worker.arena.release(handle);
+			send(worker, destination, state);
+		}
+	}
+}
+
+void ParallelSearch::send(Worker &worker, unsigned destination,
+                          const State &state)
+{
+	std::vector<State> &buffer = worker.outgoing[destination];
+	buffer.push_back(state);
+	if (buffer.size() >= BATCH_SIZE)
+		flush(worker, destination);
+}
+
+void ParallelSearch::flush(Worker &worker, unsigned destination)
+{
+	std::vector<State> &buffer = worker.outgoing[destination];
+	if (buffer.empty())
+		return;
+
+	Batch *batch = new Batch;
+	batch->states.swap(buffer);
+	buffer.reserve(BATCH_SIZE);
+	inTransit.fetch_add(batch->states.size(), std::memory_order_relaxed);
+	workers[destination].mailbox.post(batch);
+	wake(workers[destination]);
+}
+
+void ParallelSearch::receive(Worker &worker)
+{
+	for (Batch *batch = worker.mailbox.collect(), *next; batch; batch = next) {
+		for (const State &state : batch->states)
+			enqueue(worker, state);
+		inTransit.fetch_sub(batch->states.size(), std::memory_order_relaxed);
+		next = batch->next;
+		delete batch;
+	}
+}
+
+void ParallelSearch::enqueue(Worker &worker, const State &state)
+{
+	// Drop duplicates, like in the sequential search.
+	if (!worker.table.insert(state.getHash(), state.getNumMoves())) {
+		finish();
+		return;
+	}
+
+	worker.queue.push(state.getValuation(), state.getNumMoves(),
+		worker.arena.store(state));
+}
+
+void ParallelSearch::finish()
+{
+	// The search is over, if this was the last state.
+	if (pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		wakeAll();
+}
+
+void ParallelSearch::wait(Worker &worker)
+{
+	// Waking threads change what we look at before they take the lock, so
+	// either we see the change, or they notify us while we wait.
+	std::unique_lock<std::mutex> lock(worker.mutex);
+	worker.wakeup.wait(lock, [this, &worker]() {
+		return !worker.mailbox.empty() ||
+			pending.load(std::memory_order_acquire) == 0 ||
+			stopped.load(std::memory_order_relaxed);
+	});
+}
+
+void ParallelSearch::wake(Worker &worker)
+{
+	std::lock_guard<std::mutex> lock(worker.mutex);
+	worker.wakeup.notify_one();
+}
+
+void ParallelSearch::wakeAll()
+{
+	for (Worker &worker : workers)
+		wake(worker);
+}
+
+void ParallelSearch::charge(Worker &worker, const State::MoveTrie &localTrie)
+{
+	// Every thread only looks at its own data structures. The states that are
+	// on their way to another thread are counted separately.
+	std::size_t usage = worker.queue.memoryUsage() +
+		worker.arena.memoryUsage() + worker.table.memoryUsage() +
+		localTrie.memoryUsage();
+	for (const std::vector<State> &buffer : worker.outgoing)
+		usage += buffer.capacity() * stateBytes;
+	worker.usage.store(usage, std::memory_order_relaxed);
+
+	std::lock_guard<std::mutex> lock(accountMutex);
+	std::size_t total =
+		retained + inTransit.load(std::memory_order_relaxed) * stateBytes;
+	for (const Worker &other : workers)
+		total += other.usage.load(std::memory_order_relaxed);
+	if (!account->update(total)) {
+		stopped.store(true, std::memory_order_relaxed);
+		wakeAll();
+	}
+}
+
+unsigned ParallelSearch::lowestValuation()
+{
+	// All threads have stopped, so we can look at their states. Those that
+	// were sent, but not received yet, have to be taken into account too.
+	unsigned lowest = std::numeric_limits<unsigned>::max();
+	for (Worker &worker : workers) {
+		if (!worker.queue.empty())
+			lowest = std::min(lowest, worker.queue.lowestKey());
+		for (const std::vector<State> &buffer : worker.outgoing)
+			for (const State &state : buffer)
+				lowest = std::min(lowest, state.getValuation());
+		for (Batch *batch = worker.mailbox.collect(), *next; batch;
+		     batch = next) {
+			for (const State &state : batch->states)
+				lowest = std::min(lowest, state.getValuation());
+			next = batch->next;
+			delete batch;
+		}
+	}
+	return lowest;
+}
+
+} // anonymous namespace
+
+std::vector<color_t> computeBestSequenceParallel(
+	const Graph &graph, unsigned numThreads)
+{
+	if (numThreads == 0)
+		numThreads = 1;
+	return ParallelSearch(graph, numThreads).run();
+}
+
+bool continueParallel(
+	const Graph &graph, BucketQueue<StateArena::Handle> &&queue,
+	StateArena &&arena, TranspositionTable &&table, unsigned bound,
+	HelperPool &helpers, MemoryBudget::Account &account, std::size_t retained,
+	std::vector<color_t> &solution, unsigned &lowerBound)
+{
+	return ParallelSearch(graph, helpers.size(), std::move(queue),
+	                      std::move(arena), std::move(table), account, retained)
+		.resume(bound, helpers, solution, lowerBound);
+}
@@ -0,0 +1,40 @@
+#ifndef PARALLEL_HPP
+#define PARALLEL_HPP
+
+#include <vector>
+#include "bucketqueue.hpp"
+#include "floodit.hpp"
+#include "helperpool.hpp"
+#include "memorybudget.hpp"
+#include "statearena.hpp"
+#include "transposition.hpp"
+
+/**
+ * Continue an A^* search as hash-distributed A^*, which idle threads of a pool
+ * can join.
+ *
+ * The calling thread goes on with the states of the search, and hands them to
+ * other threads as they join.
+ *
+ * @param graph Graph to solve.
+ * @param queue Open list of the search.
+ * @param arena Storage of the states in the open list.
+ * @param table Transposition table of the search.
+ * @param bound Only look for solutions with a smaller valuation.
+ * @param helpers Pool of threads that may join.
+ * @param account Account of the search, charged for the memory of all
+ *        threads.
+ * @param retained Bytes the sequential search keeps using, like its move trie.
+ * @param[out] solution Best sequence, or empty if there is none with a smaller
+ *             valuation.
+ * @param[out] lowerBound Smallest valuation of states that haven't been
+ *             expanded, if the budget runs out.
+ * @return True, if the search was completed within the budget.
+ */
+bool continueParallel(
+	const Graph &graph, BucketQueue<StateArena::Handle> &&queue,
+	StateArena &&arena, TranspositionTable &&table, unsigned bound,
+	HelperPool &helpers, MemoryBudget::Account &account, std::size_t retained,
+	std::vector<color_t> &solution, unsigned &lowerBound);
+
+#endif
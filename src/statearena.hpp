@@ -0,0 +1,106 @@
+#ifndef STATEARENA_HPP
+#define STATEARENA_HPP
+
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+#include "floodit.hpp"
+
+/**
+ * Arena for the states of a search.
+ *
+ * States are stored as fixed-size records (see State::save) in large chunks,
+ * and referred to by 32-bit handles. Released records are kept in a free list
+ * for reuse, memory is only returned when the arena is destroyed.
+ */
+class StateArena
+{
+public:
+	typedef std::uint32_t Handle;
+
+	explicit StateArena(const Graph &graph)
+		: graph(graph), recordSize(State::getRecordSize(graph)),
+		  freeList(NONE), numRecords(0) {}
+
+	/**
+	 * Store a state.
+	 * @param state State to store.
+	 * @return Handle for the stored state.
+	 */
+	Handle store(const State &state)
+	{
+		Handle handle;
+		if (freeList != NONE) {
+			handle = freeList;
+			freeList = record(handle)[0];
+		}
+		else {
+			if (numRecords == NONE)
+				throw std::runtime_error("Too many states");
+			handle = numRecords++;
+			if (handle % RECORDS_PER_CHUNK == 0)
+				chunks.emplace_back(
+					new bits::word_t[RECORDS_PER_CHUNK * recordSize]);
+		}
+
+		state.save(record(handle));
+		return handle;
+	}
+
+	/**
+	 * Load a stored state.
+	 * @param handle Handle for the state.
+	 * @param state State to overwrite with the stored state.
+	 */
+	void load(Handle handle, State &state) const
+	{
+		state.load(graph, record(handle));
+	}
+
+	/**
+	 * Get the moves of a stored state, without loading it.
+	 * @param handle Handle for the state.
+	 * @return Moves that lead to the state.
+	 */
+	State::MoveTrie::Sequence getMoves(Handle handle) const
+	{
+		return State::loadMoves(record(handle));
+	}
+
+	/**
+	 * Release a stored state, so that its record can be reused.
+	 * @param handle Handle for the state, invalid afterwards.
+	 */
+	void release(Handle handle)
+	{
+		record(handle)[0] = freeList;
+		freeList = handle;
+	}
+
+	/// Bytes allocated for records, including released ones.
+	std::size_t memoryUsage() const
+	{
+		return chunks.size() * RECORDS_PER_CHUNK * recordSize
+			* sizeof(bits::word_t);
+	}
+
+private:
+	bits::word_t* record(Handle handle) const
+	{
+		return chunks[handle / RECORDS_PER_CHUNK].get()
+			+ (handle % RECORDS_PER_CHUNK) * recordSize;
+	}
+
+	static constexpr Handle NONE = ~Handle(0);
+	static constexpr unsigned RECORDS_PER_CHUNK = 1 << 12;
+
+	const Graph &graph;
+	const unsigned recordSize;      // In words.
+
+	std::vector<std::unique_ptr<bits::word_t[]>> chunks;
+	Handle freeList;                // Linked through the first word.
+	Handle numRecords;              // Number of records handed out so far.
+};
+
+#endif
@@ -0,0 +1,99 @@
+#ifndef TRANSPOSITION_HPP
+#define TRANSPOSITION_HPP
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * Transposition table for the search.
+ *
+ * Stores the smallest number of moves with which a region has been reached,
+ * keyed by the hash of the region. Open addressing with linear probing; the
+ * table grows when half full.
+ */
+class TranspositionTable
+{
+public:
+	TranspositionTable() : entries(1024), size(0) {}
+
+	/**
+	 * Record that a region has been reached.
+	 * @param hash Hash of the region.
+	 * @param numMoves Number of moves that lead to the region.
+	 * @return True, if the region hasn't been reached with at most
+	 *         @p numMoves moves before.
+	 */
+	bool insert(std::uint64_t hash, unsigned numMoves)
+	{
+		hash = normalize(hash);
+		Entry &entry = entries[find(hash)];
+		if (entry.hash == hash) {
+			if (entry.numMoves <= numMoves)
+				return false;
+			entry.numMoves = numMoves;
+			return true;
+		}
+
+		entry.hash = hash;
+		entry.numMoves = numMoves;
+		if (2 * ++size > entries.size())
+			grow();
+		return true;
+	}
+
+	/**
+	 * Get the smallest number of moves with which a region has been reached.
+	 * @param hash Hash of the region.
+	 * @return Number of moves, or -1 if the region hasn't been reached.
+	 */
+	unsigned lookup(std::uint64_t hash) const
+	{
+		hash = normalize(hash);
+		const Entry &entry = entries[find(hash)];
+		return entry.hash == hash ? entry.numMoves : -1;
+	}
+
+	/// Bytes allocated for the table.
+	std::size_t memoryUsage() const { return entries.size() * sizeof(Entry); }
+
+private:
+	struct Entry
+	{
+		std::uint64_t hash = EMPTY;
+		unsigned numMoves;
+	};
+
+	/// Hash value marking empty entries. We store it as its complement.
+	static constexpr std::uint64_t EMPTY = 0;
+
+	static std::uint64_t normalize(std::uint64_t hash)
+	{
+		return hash == EMPTY ? ~EMPTY : hash;
+	}
+
+	/// Find index of the entry for @p hash, or the empty entry to put it in.
+	std::size_t find(std::uint64_t hash) const
+	{
+		// The hash is random enough, so we can use its bits directly.
+		std::size_t mask = entries.size() - 1;
+		std::size_t index = hash & mask;
+		while (entries[index].hash != hash && entries[index].hash != EMPTY)
+			index = (index + 1) & mask;
+		return index;
+	}
+
+	void grow()
+	{
+		std::vector<Entry> old(2 * entries.size());
+		old.swap(entries);
+		for (const Entry &entry : old)
+			if (entry.hash != EMPTY)
+				entries[find(entry.hash)] = entry;
+	}
+
+private:
+	std::vector<Entry> entries;  // Size is a power of two.
+	std::size_t size;            // Number of used entries.
+};
+
+#endif
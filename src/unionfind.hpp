@@ -2,23 +2,28 @@
 #define UNIONFIND_HPP
 
 #include <numeric>
+#include <utility>
 #include <vector>
 
 /**
- * Very simple Union-find data structure.
+ * Union-find data structure with union by rank and path compression.
  */
 class UnionFind
 {
 public:
-	UnionFind(unsigned numElements) : parent(numElements, 0)
+	UnionFind(unsigned numElements) : parent(numElements), rank(numElements, 0)
 	{
 		std::iota(parent.begin(), parent.end(), 0);
 	}
 
-	unsigned find(unsigned element) const
+	unsigned find(unsigned element)
 	{
-		while (parent[element] != element)
+		// Path halving: make every other element on the path point to its
+		// grandparent, so that the next find takes half as long.
+		while (parent[element] != element) {
+			parent[element] = parent[parent[element]];
 			element = parent[element];
+		}
 		return element;
 	}
 
@@ -26,14 +31,20 @@ public:
 	{
 		a = find(a);
 		b = find(b);
-		if (a < b)
-			parent[b] = a;
-		else if (b < a)
-			parent[a] = b;
+		if (a == b)
+			return;
+
+		// Attach the shallower tree to the deeper one.
+		if (rank[a] < rank[b])
+			std::swap(a, b);
+		parent[b] = a;
+		if (rank[a] == rank[b])
+			++rank[a];
 	}
 
 private:
 	std::vector<unsigned> parent;
+	std::vector<unsigned char> rank;    // Upper bound on the tree height.
 };
 
 #endif
@@ -0,0 +1,100 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <vector>
+#include "bitset.hpp"
+
+// Widths around the word and vector boundaries.
+class BitsetTest : public testing::TestWithParam<unsigned> {};
+
+TEST_P(BitsetTest, SetAndIterate)
+{
+	const unsigned numBits = GetParam();
+	const unsigned numWords = bits::numWords(numBits);
+	std::vector<bits::word_t> set(numWords, 0);
+
+	std::vector<unsigned> expected;
+	for (unsigned i = 0; i < numBits; i += 3) {
+		bits::set(set.data(), i);
+		expected.push_back(i);
+	}
+
+	for (unsigned i = 0; i < numBits; ++i)
+		EXPECT_EQ(i % 3 == 0, bits::test(set.data(), i));
+
+	std::vector<unsigned> result;
+	bits::forEach(set.data(), numWords,
+		[&result](unsigned i) { result.push_back(i); });
+	EXPECT_EQ(expected, result);
+
+	for (unsigned i = 0; i < numBits; i += 6)
+		bits::reset(set.data(), i);
+	for (unsigned i = 0; i < numBits; ++i)
+		EXPECT_EQ(i % 6 == 3, bits::test(set.data(), i));
+}
+
+TEST_P(BitsetTest, Intersection)
+{
+	const unsigned numBits = GetParam();
+	const unsigned numWords = bits::numWords(numBits);
+	std::vector<bits::word_t> a(numWords, 0), b(numWords, 0), c(numWords);
+
+	for (unsigned i = 0; i < numBits; i += 2)
+		bits::set(a.data(), i);
+	for (unsigned i = 0; i < numBits; i += 3)
+		bits::set(b.data(), i);
+
+	EXPECT_TRUE(bits::intersect(c.data(), a.data(), b.data(), numWords));
+	EXPECT_EQ((numBits + 5) / 6,
+		bits::countIntersection(a.data(), b.data(), numWords));
+	for (unsigned i = 0; i < numBits; ++i)
+		EXPECT_EQ(i % 6 == 0, bits::test(c.data(), i));
+
+	// Only the last bit in b.
+	std::fill(b.begin(), b.end(), 0);
+	bits::set(b.data(), numBits - 1);
+	EXPECT_EQ((numBits - 1) % 2 == 0,
+		bits::intersect(c.data(), a.data(), b.data(), numWords));
+
+	// Disjoint sets.
+	std::fill(b.begin(), b.end(), 0);
+	for (unsigned i = 1; i < numBits; i += 2)
+		bits::set(b.data(), i);
+	EXPECT_FALSE(bits::intersect(c.data(), a.data(), b.data(), numWords));
+	EXPECT_EQ(0u, bits::countIntersection(a.data(), b.data(), numWords));
+}
+
+TEST_P(BitsetTest, Transfer)
+{
+	const unsigned numBits = GetParam();
+	const unsigned numWords = bits::numWords(numBits);
+	std::vector<bits::word_t> to(numWords, 0), from(numWords, 0),
+		set(numWords, 0);
+
+	for (unsigned i = 0; i < numBits; i += 2)
+		bits::set(from.data(), i);
+	for (unsigned i = 0; i < numBits; i += 4)
+		bits::set(set.data(), i);
+
+	bits::transfer(to.data(), from.data(), set.data(), numWords);
+	for (unsigned i = 0; i < numBits; ++i) {
+		EXPECT_EQ(i % 4 == 0, bits::test(to.data(), i));
+		EXPECT_EQ(i % 4 == 2, bits::test(from.data(), i));
+	}
+}
+
+TEST_P(BitsetTest, Full)
+{
+	const unsigned numBits = GetParam();
+	const unsigned numWords = bits::numWords(numBits);
+	std::vector<bits::word_t> set(numWords, 0);
+
+	for (unsigned i = 0; i < numBits; ++i) {
+		EXPECT_FALSE(bits::isFull(set.data(), numBits));
+		bits::set(set.data(), numBits - 1 - i);
+	}
+	EXPECT_TRUE(bits::isFull(set.data(), numBits));
+}
+
+INSTANTIATE_TEST_CASE_P(
+	Widths, BitsetTest,
+	::testing::Values(1u, 63u, 64u, 65u, 255u, 256u, 257u, 520u));
@@ -2,10 +2,43 @@
 #include <algorithm>
 #include <iostream>
 #include <iterator>
+#include <random>
+#include <thread>
 #include <utility>
 #include <vector>
 #include "floodit.hpp"
 
+/// Reduced graph of a random square board, always the same for a seed.
+static Graph randomGraph(unsigned seed, unsigned size, unsigned numColors,
+                         unsigned rootIndex = 0)
+{
+	std::mt19937 mt(seed);
+	std::uniform_int_distribution<int> dist(0, numColors - 1);
+	std::vector<color_t> cells(size * size);
+	for (color_t &color : cells)
+		color = dist(mt);
+	return Graph::fromGrid(size, size, cells, rootIndex);
+}
+
+/// Do the moves of a solution on a reduced graph, are all nodes filled then?
+static bool fillsGraph(const Graph &graph, const std::vector<color_t> &moves)
+{
+	std::vector<bool> filled(graph.getNumNodes());
+	filled[graph.getRootIndex()] = true;
+	for (color_t color : moves) {
+		// Nodes of the same color aren't adjacent, so one pass is enough.
+		std::vector<unsigned> expansion;
+		for (unsigned node = 0; node != graph.getNumNodes(); ++node)
+			if (filled[node])
+				for (unsigned neighbor : graph.getNeighbors(node))
+					if (!filled[neighbor] && graph.getColor(neighbor) == color)
+						expansion.push_back(neighbor);
+		for (unsigned node : expansion)
+			filled[node] = true;
+	}
+	return std::find(filled.begin(), filled.end(), false) == filled.end();
+}
+
 struct FlooditTestParam
 {
 	std::vector<color_t> colors;
@@ -13,9 +46,33 @@ struct FlooditTestParam
 	unsigned numMoves;
 };
 
-class FlooditTest : public testing::TestWithParam<FlooditTestParam> {};
+class FlooditTest : public testing::TestWithParam<FlooditTestParam>
+{
+protected:
+	Graph buildGraph();
+	void solve(std::vector<color_t> (*algorithm)(const Graph &graph),
+	           bool optimal = true);
+};
 
-TEST_P(FlooditTest, Solve)
+Graph FlooditTest::buildGraph()
+{
+	const FlooditTestParam& param = GetParam();
+	Graph graph(param.colors.size());
+
+	for (unsigned i = 0; i != param.colors.size(); ++i)
+		graph.setColor(i, param.colors[i]);
+
+	for (std::pair<unsigned, unsigned> edge : param.edges)
+		graph.addEdge(edge.first, edge.second);
+
+	// Freeze the graph. Nothing is merged, since it is already reduced.
+	graph.reduce();
+	EXPECT_EQ(param.colors.size(), graph.getNumNodes());
+	return graph;
+}
+
+void FlooditTest::solve(std::vector<color_t> (*algorithm)(const Graph &graph),
+                        bool optimal)
 {
 	const FlooditTestParam& param = GetParam();
 
@@ -32,17 +89,10 @@ TEST_P(FlooditTest, Solve)
 	);
 	std::sort(edges.begin(), edges.end());
 
-	// Build graph.
-	Graph graph(param.colors.size());
-
-	for (unsigned i = 0; i != param.colors.size(); ++i)
-		graph.setColor(i, param.colors[i]);
-
-	for (std::pair<unsigned, unsigned> edge : param.edges)
-		graph.addEdge(edge.first, edge.second);
+	Graph graph = buildGraph();
 
 	// Compute solution.
-	std::vector<color_t> solution = computeBestSequence(graph);
+	std::vector<color_t> solution = algorithm(graph);
 
 	// Verify first (pseudo-)move.
 	EXPECT_EQ(param.colors[0], solution[0]);
@@ -70,7 +120,35 @@ TEST_P(FlooditTest, Solve)
 		EXPECT_TRUE(filled[i]) << "Field " << i << " not filled";
 
 	// Check number of moves.
-	EXPECT_EQ(param.numMoves, solution.size() - 1);
+	if (optimal)
+		EXPECT_EQ(param.numMoves, solution.size() - 1);
+	else
+		EXPECT_LE(param.numMoves, solution.size() - 1);
+}
+
+TEST_P(FlooditTest, Solve)
+{
+	solve(computeBestSequence);
+}
+
+TEST_P(FlooditTest, SolveIDA)
+{
+	solve(computeBestSequenceIDA);
+}
+
+TEST_P(FlooditTest, SolveParallel)
+{
+	solve([](const Graph &graph)
+		{ return computeBestSequenceParallel(graph, 3); });
+}
+
+TEST_P(FlooditTest, SolveExternal)
+{
+	solve([](const Graph &graph)
+		{ return computeBestSequenceExternal(graph, testing::TempDir()); });
+	// Write every state to disk.
+	solve([](const Graph &graph)
+		{ return computeBestSequenceExternal(graph, testing::TempDir(), 1); });
 }
 
 static const FlooditTestParam flooditTestParams[] = {
@@ -126,5 +204,297 @@ static const FlooditTestParam flooditTestParams[] = {
 	},
 };
 
+TEST_P(FlooditTest, SolveGreedy)
+{
+	solve([](const Graph &graph) { return computeGreedySequence(graph); },
+	      false);
+	solve([](const Graph &graph) { return computeGreedySequence(graph, 1); },
+	      false);
+}
+
+TEST_P(FlooditTest, SolveWeighted)
+{
+	solve([](const Graph &graph)
+		{ return computeBoundedSequence(graph, 1).moves; });
+	solve([](const Graph &graph)
+		{ return computeBoundedSequence(graph, 2).moves; }, false);
+	solve([](const Graph &graph)
+		{ return computeBoundedSequence(graph, 2, 1).moves; });
+
+	// The lower bound holds, and sequences are within the weight.
+	Graph graph = buildGraph();
+	unsigned numMoves = GetParam().numMoves;
+	for (double weight : {1.0, 1.5, 2.0}) {
+		BoundedSequence result = computeBoundedSequence(graph, weight);
+		EXPECT_LE(result.lowerBound, numMoves);
+		EXPECT_LE(result.lowerBound, result.moves.size() - 1);
+		EXPECT_LE(result.moves.size() - 1, weight * numMoves);
+	}
+}
+
 INSTANTIATE_TEST_CASE_P(
 	FloodTest, FlooditTest, ::testing::ValuesIn(flooditTestParams));
+
+TEST(GraphTest, Reduce)
+{
+	// Path 0 - 1 - 2 - 3 - 4 with colors 0 0 1 1 0, plus edge 1 - 3.
+	Graph graph(5);
+	graph.setColor(2, 1);
+	graph.setColor(3, 1);
+	graph.setRootIndex(4);
+
+	graph.addEdge(0, 1);
+	graph.addEdge(1, 2);
+	graph.addEdge(2, 3);
+	graph.addEdge(3, 4);
+	graph.addEdge(1, 3);
+	graph.reduce();
+
+	// Nodes {0, 1}, {2, 3} and {4} remain.
+	ASSERT_EQ(3u, graph.getNumNodes());
+	EXPECT_EQ(2u, graph.getRootIndex());
+	EXPECT_EQ(0, graph.getColor(0));
+	EXPECT_EQ(1, graph.getColor(1));
+	EXPECT_EQ(0, graph.getColor(2));
+	EXPECT_EQ(std::vector<unsigned>({2, 1}), graph.getColorCounts());
+
+	const std::vector<std::vector<unsigned>> neighbors{{1}, {0, 2}, {1}};
+	for (unsigned i = 0; i != graph.getNumNodes(); ++i) {
+		Graph::NodeRange range = graph.getNeighbors(i);
+		std::vector<unsigned> actual(range.begin(), range.end());
+		std::sort(actual.begin(), actual.end());
+		EXPECT_EQ(neighbors[i], actual);
+	}
+
+	for (color_t color = 0; color != 2; ++color)
+		for (unsigned i = 0; i != graph.getNumNodes(); ++i)
+			EXPECT_EQ(graph.getColor(i) == color,
+			          bits::test(graph.getColorMask(color), i));
+}
+
+TEST(GraphTest, ReduceRenumbering)
+{
+	// Nodes 1 and 2 are merged into a part whose representative may be 2. The
+	// merged node must still be numbered by its first original node.
+	Graph graph(4);
+	graph.setColor(1, 1);
+	graph.setColor(2, 1);
+	graph.setRootIndex(3);
+
+	graph.addEdge(2, 1);
+	graph.addEdge(0, 2);
+	graph.addEdge(1, 3);
+	graph.reduce();
+
+	ASSERT_EQ(3u, graph.getNumNodes());
+	EXPECT_EQ(2u, graph.getRootIndex());
+	EXPECT_EQ(0, graph.getColor(0));
+	EXPECT_EQ(1, graph.getColor(1));
+	EXPECT_EQ(0, graph.getColor(2));
+	EXPECT_EQ(std::vector<unsigned>({2, 1}), graph.getColorCounts());
+}
+
+TEST(GraphTest, FromGrid)
+{
+	const unsigned shapes[][3] = {
+		// rows, columns, colors
+		{1, 1, 1}, {1, 9, 3}, {9, 1, 3}, {8, 8, 2}, {13, 7, 3}, {20, 30, 6},
+	};
+
+	std::mt19937 mt(42);
+	for (const unsigned *shape : shapes) {
+		unsigned rows = shape[0], columns = shape[1];
+		std::uniform_int_distribution<int> dist(0, shape[2] - 1);
+		std::vector<color_t> cells(rows * columns);
+		for (unsigned k = 0; k != 20; ++k) {
+			// Make sure that every color appears.
+			for (unsigned i = 0; i != cells.size(); ++i)
+				cells[i] = i < shape[2] ? i : dist(mt);
+			std::shuffle(cells.begin(), cells.end(), mt);
+			unsigned root = mt() % cells.size();
+
+			// Build the graph with a node per cell and reduce it.
+			Graph expected(cells.size());
+			expected.setRootIndex(root);
+			for (unsigned i = 0; i != rows; ++i) {
+				for (unsigned j = 0; j != columns; ++j) {
+					unsigned index = i * columns + j;
+					expected.setColor(index, cells[index]);
+					if (i > 0)
+						expected.addEdge(index - columns, index);
+					if (j > 0)
+						expected.addEdge(index - 1, index);
+				}
+			}
+			expected.reduce();
+
+			Graph graph = Graph::fromGrid(rows, columns, cells, root);
+			ASSERT_TRUE(graph.isReduced());
+			ASSERT_EQ(expected.getNumNodes(), graph.getNumNodes());
+			EXPECT_EQ(expected.getRootIndex(), graph.getRootIndex());
+			EXPECT_EQ(expected.getColorCounts(), graph.getColorCounts());
+			for (unsigned i = 0; i != graph.getNumNodes(); ++i) {
+				EXPECT_EQ(expected.getColor(i), graph.getColor(i));
+
+				Graph::NodeRange range = expected.getNeighbors(i);
+				std::vector<unsigned> neighbors(range.begin(), range.end());
+				std::sort(neighbors.begin(), neighbors.end());
+				range = graph.getNeighbors(i);
+				std::vector<unsigned> actual(range.begin(), range.end());
+				std::sort(actual.begin(), actual.end());
+				EXPECT_EQ(neighbors, actual);
+			}
+		}
+	}
+}
+
+TEST(GraphTest, RenumberBreadthFirst)
+{
+	Graph graph = randomGraph(7, 12, 4, 77);
+	Graph renumbered(graph);
+	renumbered.renumberBreadthFirst();
+
+	ASSERT_EQ(graph.getNumNodes(), renumbered.getNumNodes());
+	EXPECT_EQ(0u, renumbered.getRootIndex());
+	EXPECT_EQ(graph.getColor(graph.getRootIndex()), renumbered.getColor(0));
+	EXPECT_EQ(graph.getColorCounts(), renumbered.getColorCounts());
+
+	// Distances from the root never decrease with the node number, and there
+	// are as many edges as before.
+	std::vector<unsigned> distance(renumbered.getNumNodes(), -1);
+	distance[0] = 0;
+	unsigned numEdges = 0, numEdgesBefore = 0;
+	for (unsigned i = 0; i != renumbered.getNumNodes(); ++i) {
+		ASSERT_NE(-1u, distance[i]);
+		if (i > 0) {
+			EXPECT_LE(distance[i-1], distance[i]);
+		}
+		for (unsigned neighbor : renumbered.getNeighbors(i)) {
+			if (distance[neighbor] == -1u)
+				distance[neighbor] = distance[i] + 1;
+			++numEdges;
+		}
+		numEdgesBefore += graph.getNeighbors(i).size();
+	}
+	EXPECT_EQ(numEdgesBefore, numEdges);
+
+	EXPECT_EQ(computeBestSequence(graph).size(),
+	          computeBestSequence(renumbered).size());
+}
+
+TEST(MemoryBudgetTest, Accounts)
+{
+	MemoryBudget budget(100, 60);
+	{
+		MemoryBudget::Account first(budget), second(budget);
+		EXPECT_TRUE(first.update(50));
+		EXPECT_FALSE(first.update(70));
+		EXPECT_FALSE(second.update(60));
+		EXPECT_TRUE(second.update(40));
+		EXPECT_EQ(90u, budget.getUsed());
+
+		// Shrinking gives memory back.
+		EXPECT_TRUE(first.update(10));
+		EXPECT_TRUE(second.update(60));
+		EXPECT_EQ(70u, budget.getUsed());
+	}
+	EXPECT_EQ(0u, budget.getUsed());
+}
+
+TEST(MemoryBudgetTest, Solve)
+{
+	Graph graph = randomGraph(3, 16, 6);
+
+	// With almost no memory, A^* has to fall back to iterative deepening, and
+	// weighted A^* returns what it has. Both give their memory back.
+	MemoryBudget budget(1);
+	std::vector<color_t> best = computeBestSequence(graph);
+	EXPECT_EQ(best.size(), computeBestSequence(graph, budget).size());
+	BoundedSequence result = computeBoundedSequence(graph, 2, 0, budget);
+	EXPECT_LE(result.lowerBound, best.size() - 1);
+	EXPECT_LE(best.size(), result.moves.size());
+	EXPECT_EQ(0u, budget.getUsed());
+}
+
+TEST(WeightedTest, WithinWeight)
+{
+	// Weights that aren't multiples of the internal scale must not be
+	// exceeded either.
+	for (unsigned seed = 0; seed < 20; ++seed) {
+		Graph graph = randomGraph(seed, 13, 6);
+		unsigned numMoves = computeBestSequence(graph).size() - 1;
+		for (double weight : {1.1, 1.2, 1.5}) {
+			BoundedSequence result = computeBoundedSequence(graph, weight);
+			EXPECT_LE(result.moves.size() - 1, weight * numMoves);
+			EXPECT_LE(result.lowerBound, numMoves);
+		}
+	}
+}
+
+TEST(ExternalTest, Solve)
+{
+	Graph graph = randomGraph(5, 14, 5);
+
+	// A small buffer, so that buckets have to be merged from many runs.
+	EXPECT_EQ(computeBestSequence(graph).size(),
+	          computeBestSequenceExternal(graph, testing::TempDir(), 512).size());
+}
+
+TEST(ParallelTest, Solve)
+{
+	// Boards large enough that states are sent between the threads a lot.
+	for (unsigned seed = 0; seed < 32; ++seed) {
+		Graph graph = randomGraph(seed, 8 + seed % 5, 4 + seed % 5);
+		std::vector<color_t> solution = computeBestSequenceParallel(graph, 4);
+		EXPECT_EQ(computeBestSequence(graph).size(), solution.size())
+			<< "Seed " << seed;
+		EXPECT_TRUE(fillsGraph(graph, solution)) << "Seed " << seed;
+	}
+}
+
+TEST(HelperPoolTest, Solve)
+{
+	Graph graph = randomGraph(3, 16, 6);
+
+	// The other threads are idle from the start, so they join the search
+	// the first time it checks.
+	HelperPool helpers(3);
+	std::vector<std::thread> threads;
+	for (unsigned index = 1; index < helpers.size(); ++index)
+		threads.emplace_back([&helpers]() { helpers.help(); });
+	MemoryBudget unlimited;
+	std::vector<color_t> solution =
+		computeBestSequence(graph, unlimited, helpers);
+	helpers.help();
+	for (std::thread &thread : threads)
+		thread.join();
+
+	EXPECT_EQ(computeBestSequence(graph).size(), solution.size());
+	EXPECT_EQ(helpers.size(), helpers.numIdle());
+}
+
+TEST(HelperPoolTest, SolveWithinBudget)
+{
+	// The helpers join early. Then the budget runs out for all threads
+	// together, and the search goes on with iterative deepening. On the
+	// larger board, the parallel search has improved on the quick solution by
+	// then, but not reached the best one.
+	for (unsigned size : {12, 14}) {
+		Graph graph = randomGraph(size == 12 ? 1 : 5, size, 6);
+		HelperPool helpers(3);
+		std::vector<std::thread> threads;
+		for (unsigned index = 1; index < helpers.size(); ++index)
+			threads.emplace_back([&helpers]() { helpers.help(); });
+		MemoryBudget budget(1 << 19);
+		std::vector<color_t> solution =
+			computeBestSequence(graph, budget, helpers);
+		helpers.help();
+		for (std::thread &thread : threads)
+			thread.join();
+
+		EXPECT_EQ(computeBestSequence(graph).size(), solution.size())
+			<< "Size " << size;
+		EXPECT_TRUE(fillsGraph(graph, solution)) << "Size " << size;
+		EXPECT_EQ(0u, budget.getUsed());
+	}
+}
@@ -0,0 +1,82 @@
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+#include "boundedqueue.hpp"
+
+TEST(BoundedQueueTest, FirstInFirstOut)
+{
+	BoundedQueue<int> queue(3);
+	ASSERT_EQ(4u, queue.capacity());
+
+	int element;
+	EXPECT_FALSE(queue.tryPop(element));
+	for (int round = 0; round < 3; ++round) {
+		for (int i = 0; i < 4; ++i) {
+			element = 4 * round + i;
+			EXPECT_TRUE(queue.tryPush(element));
+		}
+		element = -1;
+		EXPECT_FALSE(queue.tryPush(element));
+		EXPECT_EQ(-1, element);
+
+		for (int i = 0; i < 4; ++i) {
+			ASSERT_TRUE(queue.tryPop(element));
+			EXPECT_EQ(4 * round + i, element);
+		}
+		EXPECT_FALSE(queue.tryPop(element));
+	}
+
+	queue.push(42);
+	queue.close();
+	ASSERT_TRUE(queue.pop(element));
+	EXPECT_EQ(42, element);
+	EXPECT_FALSE(queue.pop(element));
+}
+
+TEST(BoundedQueueTest, Concurrent)
+{
+	constexpr unsigned numProducers = 3, numConsumers = 3;
+	constexpr unsigned count = 10000;
+
+	// The queue is much smaller than what goes through it, so both sides have
+	// to wait for each other.
+	BoundedQueue<unsigned> queue(4);
+	std::vector<std::thread> producers, consumers;
+	for (unsigned index = 0; index < numProducers; ++index) {
+		producers.emplace_back([&queue, index]() {
+			for (unsigned i = 0; i < count; ++i)
+				queue.push(i * numProducers + index);
+		});
+	}
+
+	// Every consumer should see the elements of a producer in order.
+	std::vector<std::vector<unsigned>> received(numConsumers);
+	for (unsigned index = 0; index < numConsumers; ++index) {
+		consumers.emplace_back([&queue, &received, index]() {
+			unsigned element;
+			while (queue.pop(element))
+				received[index].push_back(element);
+		});
+	}
+
+	for (std::thread &thread : producers)
+		thread.join();
+	queue.close();
+	for (std::thread &thread : consumers)
+		thread.join();
+
+	std::vector<bool> seen(numProducers * count);
+	for (const std::vector<unsigned> &elements : received) {
+		std::vector<unsigned> last(numProducers, 0);
+		for (unsigned element : elements) {
+			ASSERT_LT(element, seen.size());
+			EXPECT_FALSE(seen[element]);
+			seen[element] = true;
+			unsigned producer = element % numProducers;
+			EXPECT_LE(last[producer], element);
+			last[producer] = element;
+		}
+	}
+	for (unsigned element = 0; element < seen.size(); ++element)
+		EXPECT_TRUE(seen[element]);
+}
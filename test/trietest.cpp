@@ -1,5 +1,7 @@
 #include <gtest/gtest.h>
+#include <thread>
 #include <vector>
+#include "concurrenttrie.hpp"
 #include "trie.hpp"
 
 TEST(TrieTest, SimpleSequence)
@@ -47,6 +49,42 @@ TEST(TrieTest, SequenceWithBranches)
 	}
 }
 
+TEST(TrieTest, Rewind)
+{
+	constexpr unsigned char size = 64;
+
+	Trie<unsigned char> trie;
+	auto element = trie.initial();
+	for (unsigned char i = 0; i < size; ++i)
+		element = trie.append(element, i);
+
+	// Append and rewind a branch repeatedly: it should reuse the storage.
+	std::size_t mark = trie.mark();
+	for (unsigned char round = 0; round < 4; ++round) {
+		auto branch = element;
+		for (unsigned char i = 0; i < size; ++i)
+			branch = trie.append(branch, round + i);
+
+		ASSERT_EQ(2 * size, branch.size());
+		unsigned char result[2 * size];
+		branch.materialize(result);
+		for (unsigned char i = 0; i < size; ++i) {
+			EXPECT_EQ(i, result[i]);
+			EXPECT_EQ(round + i, result[size + i]);
+		}
+
+		EXPECT_LT(mark, trie.mark());
+		trie.rewind(mark);
+		EXPECT_EQ(mark, trie.mark());
+	}
+
+	// The original sequence is still valid.
+	unsigned char result[size];
+	element.materialize(result);
+	for (unsigned char i = 0; i < size; ++i)
+		EXPECT_EQ(i, result[i]);
+}
+
 TEST(TrieTest, BinaryTree)
 {
 	constexpr unsigned depth = 12;
@@ -73,3 +111,133 @@ TEST(TrieTest, BinaryTree)
 			EXPECT_EQ((i >> bit) & 1, result[(depth-1) - bit]);
 	}
 }
+
+TEST(TrieTest, Packed)
+{
+	constexpr unsigned char size = 64;
+
+	// Two elements per byte need half as many blocks.
+	Trie<unsigned char> trie;
+	Trie<unsigned char, 4> packed;
+	auto element = trie.initial();
+	auto packedElement = packed.initial();
+	for (unsigned char i = 0; i < size; ++i) {
+		element = trie.append(element, i % 16);
+		packedElement = packed.append(packedElement, i % 16);
+		EXPECT_EQ(i % 16, packedElement.back());
+	}
+	EXPECT_EQ(trie.getStats().totalBlocks / 2, packed.getStats().totalBlocks);
+
+	ASSERT_EQ(size, packedElement.size());
+	unsigned char result[size];
+	packedElement.materialize(result);
+	for (unsigned char i = 0; i < size; ++i)
+		EXPECT_EQ(i % 16, result[i]);
+
+	// Elements that share a byte don't affect each other.
+	Trie<unsigned char, 2> pairs;
+	auto left = pairs.append(pairs.initial(), 3);
+	auto right = pairs.append(left, 0);
+	left = pairs.append(left, 2);
+	EXPECT_EQ(0, right.back());
+	EXPECT_EQ(2, left.back());
+	right.materialize(result);
+	EXPECT_EQ(3, result[0]);
+	EXPECT_EQ(0, result[1]);
+}
+
+TEST(TrieTest, Sweep)
+{
+	constexpr unsigned char size = 64;
+
+	Trie<unsigned char> trie;
+	auto element = trie.initial();
+	std::vector<decltype(element)> branches;
+	for (unsigned char i = 0; i < size; ++i) {
+		element = trie.append(element, i);
+		auto branch = element;
+		for (unsigned char j = 0; j < size; ++j)
+			branch = trie.append(branch, j);
+		branches.push_back(branch);
+	}
+
+	Trie<unsigned char>::Stats stats = trie.getStats();
+	EXPECT_EQ(stats.totalBlocks, stats.liveBlocks);
+
+	// Keep every other branch, the others are reclaimed.
+	trie.markLive(element);
+	for (unsigned char i = 0; i < size; i += 2)
+		trie.markLive(branches[i]);
+	trie.sweep();
+	stats = trie.getStats();
+	EXPECT_LT(stats.liveBlocks, stats.totalBlocks * 3 / 5);
+	EXPECT_GT(stats.liveBlocks, stats.totalBlocks * 2 / 5);
+
+	// New, shorter branches reuse the reclaimed blocks.
+	for (unsigned char i = 1; i < size; i += 2) {
+		auto branch = element;
+		for (unsigned char j = 0; j < size / 2; ++j)
+			branch = trie.append(branch, i + j);
+		branches[i] = branch;
+	}
+	EXPECT_EQ(stats.totalBlocks, trie.getStats().totalBlocks);
+	EXPECT_LT(stats.liveBlocks, trie.getStats().liveBlocks);
+
+	unsigned char result[2 * size];
+	for (unsigned char i = 0; i < size; ++i) {
+		bool even = i % 2 == 0;
+		unsigned prefix = even ? i + 1 : size, length = even ? size : size / 2;
+		ASSERT_EQ(prefix + length, branches[i].size());
+		branches[i].materialize(result);
+		for (unsigned char j = 0; j < prefix; ++j)
+			EXPECT_EQ(j, result[j]);
+		for (unsigned char j = 0; j < length; ++j)
+			EXPECT_EQ(even ? j : i + j, result[prefix + j]);
+	}
+}
+
+TEST(TrieTest, Concurrent)
+{
+	constexpr unsigned char size = 64;
+	constexpr unsigned numThreads = 4;
+
+	ConcurrentTrie<unsigned char> trie;
+	auto element = trie.initial();
+	for (unsigned char i = 0; i < size; ++i)
+		element = trie.append(element, i);
+
+	// Every thread branches off the common sequence, then continues the branch
+	// of the next thread.
+	std::vector<decltype(element)> branches(numThreads, element);
+	for (unsigned round = 0; round < 2; ++round) {
+		std::vector<decltype(element)> next(branches);
+		std::vector<std::thread> threads;
+		for (unsigned index = 0; index < numThreads; ++index) {
+			threads.emplace_back([&, index]() {
+				auto branch = branches[(index + round) % numThreads];
+				for (unsigned char i = 0; i < size; ++i)
+					branch = trie.append(branch, index + i);
+				next[index] = branch;
+			});
+		}
+		for (std::thread &thread : threads)
+			thread.join();
+		branches.swap(next);
+	}
+
+	unsigned char result[3 * size];
+	for (unsigned index = 0; index < numThreads; ++index) {
+		ASSERT_EQ(3 * size, branches[index].size());
+		branches[index].materialize(result);
+		unsigned previous = (index + 1) % numThreads;
+		for (unsigned char i = 0; i < size; ++i) {
+			EXPECT_EQ(i, result[i]);
+			EXPECT_EQ(previous + i, result[size + i]);
+			EXPECT_EQ(index + i, result[2 * size + i]);
+		}
+	}
+
+	Trie<unsigned char>::Stats stats = trie.getStats();
+	EXPECT_EQ(stats.totalBlocks, stats.liveBlocks);
+	EXPECT_LE((1 + 2 * numThreads) * (size / 8), stats.totalBlocks);
+}